@@ -0,0 +1,325 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Milliseconds between write-behind flushes of dirty sectors. */
+#define FLUSH_INTERVAL_MS 1000
+
+/* Most sectors waiting to be read ahead. */
+#define READ_AHEAD_MAX 16
+
+/* A cached sector of fs_device. */
+struct cache_entry
+  {
+    struct hash_elem elem;              /* Element in cache_map. */
+    block_sector_t sector;              /* Sector held, if in_use. */
+    bool in_use;                        /* Holds a sector. */
+    bool dirty;                         /* Newer than the disk. */
+    bool accessed;                      /* Used since the clock passed. */
+    bool busy;                          /* Disk transfer in progress. */
+    unsigned txn;                       /* Journal transaction, or 0. */
+    uint8_t data[BLOCK_SECTOR_SIZE];
+  };
+
+static struct cache_entry *entries;
+static size_t entry_cnt;
+static size_t clock_hand;
+
+/* Entries that hold a sector, by sector number. */
+static struct hash cache_map;
+
+/* Guards every entry, cache_map and the read-ahead queue.  An
+   entry's data may only change with the lock held and the entry
+   not busy.  The lock is released around disk transfers, during
+   which the entry is busy. */
+static struct lock cache_lock;
+static struct condition transfer_done;  /* An entry stopped being busy. */
+
+/* Sectors to read ahead, in a ring. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct condition read_ahead_ready;
+
+static void flush_daemon (void *aux);
+static void read_ahead_daemon (void *aux);
+
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct cache_entry, elem)->sector);
+}
+
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct cache_entry, elem)->sector
+          < hash_entry (b, struct cache_entry, elem)->sector);
+}
+
+/* Sets up a buffer cache of SECTOR_CNT sectors in front of
+   fs_device and starts its write-behind and read-ahead
+   threads. */
+void
+cache_init (size_t sector_cnt)
+{
+  entry_cnt = sector_cnt > 0 ? sector_cnt : CACHE_DEFAULT_SECTORS;
+  entries = calloc (entry_cnt, sizeof *entries);
+  if (entries == NULL)
+    PANIC ("Failed to allocate buffer cache");
+  hash_init (&cache_map, entry_hash, entry_less, NULL);
+  lock_init (&cache_lock);
+  cond_init (&transfer_done);
+  cond_init (&read_ahead_ready);
+
+  thread_create ("cache-flush", PRI_DEFAULT, flush_daemon, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer.  Must
+   hold cache_lock. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&cache_map, &key.elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Returns true if E may be written back: it does not hold
+   metadata, or the journal has committed the transaction that
+   last changed it.  Must hold cache_lock. */
+static bool
+may_write_back (const struct cache_entry *e)
+{
+  return e->txn == 0 || journal_committed (e->txn);
+}
+
+/* Writes E back to disk, releasing cache_lock meanwhile.  Must
+   hold cache_lock, with E dirty and not busy. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (e->dirty && !e->busy);
+  e->busy = true;
+  lock_release (&cache_lock);
+  block_write (fs_device, e->sector, e->data);
+  lock_acquire (&cache_lock);
+  e->busy = false;
+  e->dirty = false;
+  cond_broadcast (&transfer_done, &cache_lock);
+}
+
+/* Runs the clock over the entries and returns a free or
+   least-recently-used one that is not busy, or a null pointer if
+   it had to write a dirty victim back or wait for a transfer
+   first, in which case the caller must start over.  A victim
+   with metadata not yet committed is dropped without writing
+   it: the journal holds its contents.  Must hold cache_lock. */
+static struct cache_entry *
+pick_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * entry_cnt; i++)
+    {
+      struct cache_entry *e = &entries[clock_hand];
+      clock_hand = (clock_hand + 1) % entry_cnt;
+
+      if (!e->in_use)
+        return e;
+      if (e->busy)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else if (e->dirty && may_write_back (e))
+        {
+          write_back (e);
+          return NULL;
+        }
+      else
+        return e;
+    }
+
+  /* Everything is busy. */
+  cond_wait (&transfer_done, &cache_lock);
+  return NULL;
+}
+
+/* Returns the entry for SECTOR, bringing it into the cache if
+   needed.  The sector is read from the journal, or else from
+   disk, unless LOAD is false, when the caller is about to
+   overwrite all of it.  Must hold
+   cache_lock, which is released and reacquired around disk
+   transfers. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          if (!e->busy)
+            break;
+          cond_wait (&transfer_done, &cache_lock);
+          continue;
+        }
+
+      e = pick_victim ();
+      if (e == NULL)
+        continue;
+
+      if (e->in_use)
+        hash_delete (&cache_map, &e->elem);
+      e->in_use = true;
+      e->sector = sector;
+      e->dirty = false;
+      e->txn = 0;
+      hash_insert (&cache_map, &e->elem);
+      if (load)
+        {
+          e->busy = true;
+          lock_release (&cache_lock);
+          if (!journal_read (sector, e->data))
+            block_read (fs_device, sector, e->data);
+          lock_acquire (&cache_lock);
+          e->busy = false;
+          cond_broadcast (&transfer_done, &cache_lock);
+        }
+      break;
+    }
+  e->accessed = true;
+  return e;
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR.
+   The sector reaches the disk later, when it is evicted or
+   flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer, size_t ofs,
+             size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes of metadata from BUFFER at offset OFS within
+   SECTOR, as cache_write() does, and logs the new contents of
+   the sector in the journal's running transaction.  The sector
+   reaches the disk only after that transaction commits. */
+void
+cache_write_meta (block_sector_t sector, const void *buffer, size_t ofs,
+                  size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  e->txn = journal_log (sector, e->data);
+  lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be brought into the cache in the
+   background, in anticipation of a sequential read.  The
+   request is dropped if SECTOR is cached already or too many
+   are pending. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (lookup (sector) == NULL && read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      read_ahead_queue[(read_ahead_head + read_ahead_cnt++)
+                       % READ_AHEAD_MAX] = sector;
+      cond_signal (&read_ahead_ready, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector back to disk, except metadata that
+   the journal has not yet committed. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < entry_cnt; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      while (e->busy)
+        cond_wait (&transfer_done, &cache_lock);
+      if (e->in_use && e->dirty && may_write_back (e))
+        write_back (e);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Write-behind thread: periodically asks the journal to commit
+   the metadata changed since last time, and flushes dirty
+   sectors, so that little is lost in a crash and eviction rarely
+   has to wait for a write. */
+static void
+flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_msleep (FLUSH_INTERVAL_MS);
+      journal_request_commit ();
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread: loads the sectors queued by
+   cache_read_ahead(). */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      block_sector_t sector;
+
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &cache_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      get_entry (sector, true);
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Default number of sectors in the buffer cache. */
+#define CACHE_DEFAULT_SECTORS 64
+
+void cache_init (size_t sector_cnt);
+void cache_read (block_sector_t, void *, size_t ofs, size_t size);
+void cache_write (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_write_meta (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_read_ahead (block_sector_t);
+void cache_flush (void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,162 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Dentry cache.
+
+   Remembers what recent lookups of a name in a directory found,
+   keyed by the directory's inode sector and the name, so that
+   resolving a path takes a hash probe per component rather than
+   a search of each directory.  A name found not to exist is
+   remembered too, as sector 0, which never holds a file.
+   Directories keep the cache up to date as they add and remove
+   names.  The least recently used entry makes way for a new one
+   once DCACHE_ENTRIES are cached. */
+
+/* A cached name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name within DIR. */
+    block_sector_t sector;              /* Inode sector, or 0 if none. */
+  };
+
+static struct dentry *dentries_buf;     /* Every dentry. */
+static struct hash dentries;            /* Cached dentries. */
+static struct list lru_list;            /* Cached, least recent first. */
+static struct list free_list;           /* Not cached. */
+static struct lock dcache_lock;         /* Guards all of the above. */
+
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  dentries_buf = calloc (DCACHE_ENTRIES, sizeof *dentries_buf);
+  if (dentries_buf == NULL)
+    PANIC ("can't allocate dentry cache");
+  hash_init (&dentries, dentry_hash, dentry_less, NULL);
+  list_init (&lru_list);
+  list_init (&free_list);
+  lock_init (&dcache_lock);
+  for (i = 0; i < DCACHE_ENTRIES; i++)
+    list_push_back (&free_list, &dentries_buf[i].lru_elem);
+}
+
+/* Returns the cached dentry for NAME in directory DIR, or a null
+   pointer.  Must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows the answer, stores the sector of NAME's
+   inode into *SECTOR, or 0 if NAME does not exist, and returns
+   true.  Returns false if NAME must be looked up in DIR. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sector)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      *sector = d->sector;
+      list_remove (&d->lru_elem);
+      list_push_back (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector DIR
+   has its inode in SECTOR, or does not exist if SECTOR is 0. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      if (!list_empty (&free_list))
+        d = list_entry (list_pop_front (&free_list), struct dentry, lru_elem);
+      else
+        {
+          d = list_entry (list_pop_front (&lru_list), struct dentry, lru_elem);
+          hash_delete (&dentries, &d->hash_elem);
+        }
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  else
+    list_remove (&d->lru_elem);
+  d->sector = sector;
+  list_push_back (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name cached for the directory whose inode is in
+   sector DIR, which is being removed, so that nothing cached
+   outlives the reuse of its sector. */
+void
+dcache_forget_dir (block_sector_t dir)
+{
+  struct list_elem *e;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru_list); e != list_end (&lru_list); )
+    {
+      struct dentry *d = list_entry (e, struct dentry, lru_elem);
+      e = list_next (e);
+      if (d->dir == dir)
+        {
+          hash_delete (&dentries, &d->hash_elem);
+          list_remove (&d->lru_elem);
+          list_push_back (&free_list, &d->lru_elem);
+        }
+    }
+  lock_release (&dcache_lock);
+}
@@ -0,0 +1,17 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of names the dentry cache remembers. */
+#define DCACHE_ENTRIES 512
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t dir, const char *name,
+                    block_sector_t *sector);
+void dcache_insert (block_sector_t dir, const char *name,
+                    block_sector_t sector);
+void dcache_forget_dir (block_sector_t dir);
+
+#endif /* filesys/dcache.h */
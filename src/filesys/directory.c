@@ -1,7 +1,10 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -21,12 +24,121 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Directory format.
+
+   A directory uses extendible hashing over blocks of
+   BLOCK_SECTOR_SIZE bytes.  Block 0 holds a struct dir_header,
+   which lists the table blocks.  Together they map each value of
+   the low DEPTH bits of a name's hash to the block of the bucket
+   that holds the name.  A bucket holds the entries whose hashes
+   agree in their low bits with its own, up to its own depth.  A
+   full bucket is split in two on one more bit, and if it already
+   used all DEPTH bits, the table is doubled first.  Looking up,
+   adding or removing a name thus reads a header, a table and a
+   bucket block however large the directory grows.
+
+   A directory does not store "." or "..".  Its header records its
+   parent instead. */
+
+/* Identifies a directory header. */
+#define DIR_MAGIC 0xd1d1d1d1
+
+/* Identifies a bucket block. */
+#define BUCKET_MAGIC 0xb0c4e7b0
+
+/* Bucket block indexes per table block, and table blocks listed
+   in the header. */
+#define TABLE_PTRS (BLOCK_SECTOR_SIZE / sizeof (uint32_t))
+#define HEADER_TABLES 125
+
+/* Most hash bits a directory's table uses. */
+#define MAX_DEPTH 13
+
+/* Entries per bucket. */
+#define BUCKET_ENTRIES 25
+
+/* Block 0 of a directory. */
+struct dir_header
+  {
+    uint32_t magic;                     /* DIR_MAGIC. */
+    uint32_t depth;                     /* Hash bits the table uses. */
+    uint32_t parent;                    /* Parent's inode sector. */
+    uint32_t tables[HEADER_TABLES];     /* Blocks of the table. */
+  };
+
+/* A bucket block of a directory. */
+struct dir_bucket
+  {
+    uint32_t magic;                     /* BUCKET_MAGIC. */
+    uint32_t depth;                     /* Hash bits its names share. */
+    struct dir_entry entries[BUCKET_ENTRIES];
+    uint8_t unused[4];                  /* Not used. */
+  };
+
+static bool next_entry (struct dir *, char name[NAME_MAX + 1]);
+
+/* Reads SIZE bytes at offset OFS within block BLOCK of directory
+   INODE into BUFFER.  Returns true if successful. */
+static bool
+read_block (struct inode *inode, size_t block, void *buffer,
+            size_t ofs, size_t size)
+{
+  return (inode_read_at (inode, buffer, size, block * BLOCK_SECTOR_SIZE + ofs)
+          == (off_t) size);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within block BLOCK
+   of directory INODE.  Returns true if successful. */
+static bool
+write_block (struct inode *inode, size_t block, const void *buffer,
+             size_t ofs, size_t size)
+{
+  return (inode_write_at (inode, buffer, size, block * BLOCK_SECTOR_SIZE + ofs)
+          == (off_t) size);
+}
+
+/* Creates a directory in the given SECTOR, with one empty
+   bucket, inside the directory whose inode is in
+   sector PARENT.  Returns true if successful, false on
+   failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header *header;
+  struct dir_bucket *bucket;
+  uint32_t *table;
+  struct inode *inode;
+  bool success = false;
+
+  ASSERT (sizeof *header == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof *bucket == BLOCK_SECTOR_SIZE);
+
+  /* The writes below allocate the header, the first table block
+     and the first bucket. */
+  if (!inode_create (sector, 3 * BLOCK_SECTOR_SIZE, true))
+    return false;
+  inode = inode_open (sector);
+  header = calloc (1, sizeof *header);
+  table = calloc (TABLE_PTRS, sizeof *table);
+  bucket = calloc (1, sizeof *bucket);
+  if (inode != NULL && header != NULL && table != NULL && bucket != NULL)
+    {
+      header->magic = DIR_MAGIC;
+      header->depth = 0;
+      header->parent = parent;
+      header->tables[0] = 1;
+      table[0] = 2;
+      bucket->magic = BUCKET_MAGIC;
+      bucket->depth = 0;
+      success = (write_block (inode, 0, header, 0, sizeof *header)
+                 && write_block (inode, 1, table, 0, BLOCK_SECTOR_SIZE)
+                 && write_block (inode, 2, bucket, 0, sizeof *bucket));
+    }
+  free (bucket);
+  free (table);
+  free (header);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -83,6 +195,182 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns the sector of the inode of DIR's parent, or 0 on
+   error. */
+static block_sector_t
+parent_sector (const struct dir *dir)
+{
+  uint32_t parent;
+
+  if (!read_block (dir->inode, 0, &parent,
+                   offsetof (struct dir_header, parent), sizeof parent))
+    return 0;
+  return parent;
+}
+
+/* Returns the number of hash bits the table of directory DIR
+   uses, or -1 on error. */
+static int
+table_depth (const struct dir *dir)
+{
+  uint32_t depth;
+  if (!read_block (dir->inode, 0, &depth,
+                   offsetof (struct dir_header, depth), sizeof depth))
+    return -1;
+  return depth;
+}
+
+/* Returns the location of entry SLOT of the table of directory
+   DIR, as a block in *BLOCK and a byte offset in *OFS.
+   Returns false on error. */
+static bool
+locate_slot (const struct dir *dir, size_t slot, uint32_t *block,
+             size_t *ofs)
+{
+  if (!read_block (dir->inode, 0, block,
+                   offsetof (struct dir_header, tables)
+                   + slot / TABLE_PTRS * sizeof *block, sizeof *block))
+    return false;
+  *ofs = slot % TABLE_PTRS * sizeof (uint32_t);
+  return true;
+}
+
+/* Returns the bucket block that entry SLOT of the table of
+   directory DIR points to, or 0 on error. */
+static uint32_t
+get_slot (const struct dir *dir, size_t slot)
+{
+  uint32_t table, bucket;
+  size_t ofs;
+
+  if (!locate_slot (dir, slot, &table, &ofs)
+      || !read_block (dir->inode, table, &bucket, ofs, sizeof bucket))
+    return 0;
+  return bucket;
+}
+
+/* Points entry SLOT of the table of directory DIR to
+   bucket block BUCKET.  Returns false on error. */
+static bool
+set_slot (struct dir *dir, size_t slot, uint32_t bucket)
+{
+  uint32_t table;
+  size_t ofs;
+
+  return (locate_slot (dir, slot, &table, &ofs)
+          && write_block (dir->inode, table, &bucket, ofs, sizeof bucket));
+}
+
+/* Returns the index of the block just past the end of DIR. */
+static size_t
+end_block (const struct dir *dir)
+{
+  return inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+}
+
+/* Finds the bucket for NAME in directory DIR, reads it
+   into BUCKET, and stores its block into *BLOCK and the table
+   slot that led there into *SLOT.  Returns false on error. */
+static bool
+find_bucket (const struct dir *dir, const char *name,
+             struct dir_bucket *bucket, uint32_t *block, size_t *slot)
+{
+  int depth = table_depth (dir);
+
+  if (depth < 0)
+    return false;
+  *slot = hash_string (name) & ((1u << depth) - 1);
+  *block = get_slot (dir, *slot);
+  return (*block != 0
+          && read_block (dir->inode, *block, bucket, 0, sizeof *bucket)
+          && bucket->magic == BUCKET_MAGIC);
+}
+
+/* Doubles the table of directory DIR, which uses DEPTH
+   hash bits, by pointing each new slot to the same bucket as the
+   slot it extends.  Returns false on error. */
+static bool
+grow_table (struct dir *dir, int depth)
+{
+  static const uint32_t zeros[TABLE_PTRS];
+  size_t old_cnt = (size_t) 1 << depth;
+  size_t slot;
+  uint32_t new_depth = depth + 1;
+
+  /* Add table blocks for the new slots. */
+  for (slot = old_cnt; slot < 2 * old_cnt; slot += TABLE_PTRS)
+    if (slot % TABLE_PTRS == 0)
+      {
+        uint32_t table = end_block (dir);
+        if (!write_block (dir->inode, table, zeros, 0, BLOCK_SECTOR_SIZE)
+            || !write_block (dir->inode, 0, &table,
+                             offsetof (struct dir_header, tables)
+                             + slot / TABLE_PTRS * sizeof table,
+                             sizeof table))
+          return false;
+      }
+
+  for (slot = old_cnt; slot < 2 * old_cnt; slot++)
+    if (!set_slot (dir, slot, get_slot (dir, slot - old_cnt)))
+      return false;
+  return write_block (dir->inode, 0, &new_depth,
+                      offsetof (struct dir_header, depth), sizeof new_depth);
+}
+
+/* Splits full BUCKET, stored at block BLOCK of directory DIR and
+   reached through table slot SLOT, on one more hash bit, moving
+   the names with that bit set to a new bucket.  Returns false if
+   DIR cannot grow further or on error. */
+static bool
+split_bucket (struct dir *dir, struct dir_bucket *bucket, uint32_t block,
+              size_t slot)
+{
+  int depth = table_depth (dir);
+  struct dir_bucket *sibling;
+  uint32_t sibling_block;
+  uint32_t bit;
+  size_t i;
+  bool success;
+
+  if (depth < 0)
+    return false;
+  if (bucket->depth == (uint32_t) depth)
+    {
+      if (depth == MAX_DEPTH || !grow_table (dir, depth))
+        return false;
+      depth++;
+    }
+
+  sibling = calloc (1, sizeof *sibling);
+  if (sibling == NULL)
+    return false;
+  bit = 1u << bucket->depth;
+  sibling->magic = BUCKET_MAGIC;
+  sibling->depth = ++bucket->depth;
+  for (i = 0; i < BUCKET_ENTRIES; i++)
+    {
+      struct dir_entry *e = &bucket->entries[i];
+      if (e->in_use && (hash_string (e->name) & bit))
+        {
+          sibling->entries[i] = *e;
+          e->in_use = false;
+        }
+    }
+
+  /* Write the new bucket before pointing the table at it, and
+     the old one after. */
+  sibling_block = end_block (dir);
+  success = write_block (dir->inode, sibling_block, sibling, 0,
+                         sizeof *sibling);
+  for (i = (slot & (bit - 1)) | bit; success && i < (1u << depth);
+       i += bit << 1)
+    success = set_slot (dir, i, sibling_block);
+  if (success)
+    success = write_block (dir->inode, block, bucket, 0, sizeof *bucket);
+  free (sibling);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,46 +380,117 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
-  
+  struct dir_bucket *bucket;
+  bool found = false;
+  uint32_t block;
+  size_t slot, i;
+
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  bucket = malloc (sizeof *bucket);
+  if (bucket != NULL && find_bucket (dir, name, bucket, &block, &slot))
+    for (i = 0; i < BUCKET_ENTRIES; i++)
+      if (bucket->entries[i].in_use
+          && !strcmp (name, bucket->entries[i].name))
+        {
+          if (ep != NULL)
+            *ep = bucket->entries[i];
+          if (ofsp != NULL)
+            *ofsp = (block * BLOCK_SECTOR_SIZE
+                     + offsetof (struct dir_bucket, entries)
+                     + i * sizeof (struct dir_entry));
+          found = true;
+          break;
+        }
+  free (bucket);
+  return found;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
+   "." names DIR itself and ".." its parent.  A directory that was
+   removed contains nothing, not even those.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
+  dir_sector = inode_get_inumber (dir->inode);
+  *inode = NULL;
+
+  inode_lock_dir (dir->inode);
+  if (inode_is_removed (dir->inode))
     *inode = NULL;
+  else if (!strcmp (name, "."))
+    *inode = inode_reopen (dir->inode);
+  else if (!strcmp (name, ".."))
+    {
+      sector = parent_sector (dir);
+      if (sector != 0)
+        *inode = inode_open (sector);
+    }
+  else if (dcache_lookup (dir_sector, name, &sector))
+    {
+      if (sector != 0)
+        *inode = inode_open (sector);
+    }
+  else if (lookup (dir, name, &e, NULL))
+    {
+      dcache_insert (dir_sector, name, e.inode_sector);
+      *inode = inode_open (e.inode_sector);
+    }
+  else
+    dcache_insert (dir_sector, name, 0);
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
 
+/* Adds NAME, whose inode is in sector INODE_SECTOR, to directory
+   DIR, splitting its bucket as often as it takes to make room.
+   Returns true if successful, false on failure. */
+static bool
+add_entry (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  struct dir_bucket *bucket = malloc (sizeof *bucket);
+  bool success = false;
+
+  while (bucket != NULL)
+    {
+      uint32_t block;
+      size_t slot, i;
+
+      if (!find_bucket (dir, name, bucket, &block, &slot))
+        break;
+      for (i = 0; i < BUCKET_ENTRIES; i++)
+        if (!bucket->entries[i].in_use)
+          break;
+      if (i < BUCKET_ENTRIES)
+        {
+          struct dir_entry *e = &bucket->entries[i];
+          e->in_use = true;
+          strlcpy (e->name, name, sizeof e->name);
+          e->inode_sector = inode_sector;
+          success = write_block (dir->inode, block, e,
+                                 offsetof (struct dir_bucket, entries)
+                                 + i * sizeof *e, sizeof *e);
+          break;
+        }
+      if (!split_bucket (dir, bucket, block, slot))
+        break;
+    }
+  free (bucket);
+  return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -141,58 +500,59 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX
+      || !strcmp (name, ".") || !strcmp (name, ".."))
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
-    goto done;
-
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* Check that DIR was not removed and NAME is not in use. */
+  inode_lock_dir (dir->inode);
+  if (!inode_is_removed (dir->inode) && !lookup (dir, name, NULL, NULL))
+    success = add_entry (dir, name, inode_sector);
 
- done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
+/* Returns true if directory INODE has no entries.  The caller
+   must hold its lock. */
+static bool
+is_empty (struct inode *inode)
+{
+  struct dir dir;
+  char name[NAME_MAX + 1];
+
+  dir.inode = inode;
+  dir.pos = 0;
+  return !next_entry (&dir, name);
+}
+
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, or if it is a directory
+   that is not empty or is open elsewhere, as a working directory
+   or otherwise. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
+  bool inode_locked = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  inode_lock_dir (dir->inode);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -201,36 +561,84 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* A directory's own lock keeps entries from being added to it
+     until it is marked removed.  With DIR locked too, no one can
+     open it by name meanwhile. */
+  if (inode_is_dir (inode))
+    {
+      inode_lock_dir (inode);
+      inode_locked = true;
+      if (inode_open_cnt (inode) > 1 || !is_empty (inode))
+        goto done;
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
   /* Remove inode. */
+  dcache_insert (inode_get_inumber (dir->inode), name, 0);
+  if (inode_is_dir (inode))
+    dcache_forget_dir (e.inode_sector);
   inode_remove (inode);
   success = true;
 
  done:
+  if (inode_locked)
+    inode_unlock_dir (inode);
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
-bool
-dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+   contains no more entries.  The position counts entries of
+   every block, whether bucket or not.  The caller must hold DIR's
+   lock. */
+static bool
+next_entry (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
+  struct dir_bucket *bucket = malloc (sizeof *bucket);
+  size_t block_cnt = end_block (dir);
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  while (bucket != NULL && !found
+         && (size_t) dir->pos / BUCKET_ENTRIES < block_cnt)
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      size_t block = dir->pos / BUCKET_ENTRIES;
+      size_t i = dir->pos % BUCKET_ENTRIES;
+
+      if (block == 0
+          || !read_block (dir->inode, block, bucket, 0, sizeof *bucket)
+          || bucket->magic != BUCKET_MAGIC)
         {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
+          dir->pos = (block + 1) * BUCKET_ENTRIES;
+          continue;
+        }
+      for (; i < BUCKET_ENTRIES && !found; i++)
+        if (bucket->entries[i].in_use)
+          {
+            strlcpy (name, bucket->entries[i].name, NAME_MAX + 1);
+            found = true;
+          }
+      dir->pos = block * BUCKET_ENTRIES + i;
     }
-  return false;
+  free (bucket);
+  return found;
+}
+
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  bool success;
+
+  inode_lock_dir (dir->inode);
+  success = next_entry (dir, name);
+  inode_unlock_dir (dir->inode);
+  return success;
 }
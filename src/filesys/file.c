@@ -2,6 +2,7 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "vm/frame.h"
 
 /* An open file. */
 struct file 
@@ -64,11 +65,12 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   The data is copied out of the page cache. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = pcache_read (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -77,20 +79,21 @@ file_read (struct file *file, void *buffer, off_t size)
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   The file's current position is unaffected. */
+   The file's current position is unaffected.
+   The data is copied out of the page cache. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  return pcache_read (file->inode, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   Advances FILE's position by the number of bytes read. */
+   which may be less than SIZE if the disk fills up.
+   Writing past end of file grows the file.
+   Advances FILE's position by the number of bytes read.
+   The data goes to disk and to any cached copy of it. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
@@ -102,10 +105,10 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   The file's current position is unaffected. */
+   which may be less than SIZE if the disk fills up.
+   Writing past end of file grows the file.
+   The file's current position is unaffected.
+   The data goes to disk and to any cached copy of it. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
@@ -2,26 +2,35 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "threads/init.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
 
-/* Initializes the file system module.
+/* Initializes the file system module, with a buffer cache of
+   CACHE_SECTORS sectors, or the default if 0.
    If FORMAT is true, reformats the file system. */
 void
-filesys_init (bool format) 
+filesys_init (bool format, size_t cache_sectors) 
 {
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init (cache_sectors);
+  journal_init (format);
   inode_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -35,24 +44,173 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  if (fs_crash)
+    {
+      /* Leave the last transaction for the next boot to replay. */
+      journal_crash ();
+      return;
+    }
+  journal_commit ();
   free_map_close ();
+  cache_flush ();
 }
 
+/* Writes every change made to the file system so far to disk,
+   committing the metadata through the journal, before
+   returning. */
+void
+filesys_sync (void)
+{
+  journal_commit ();
+  cache_flush ();
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory that holds the last component of PATH and
+   copies that component into NAME.  PATH is absolute if it
+   starts with "/", and otherwise relative to the current
+   process's working directory.  A PATH of just "/" names "." in
+   the root directory.
+   Returns a null pointer if PATH is empty, has a component that
+   is too long, or leads through something that is not a
+   directory. */
+static struct dir *
+open_parent (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  struct dir *dir;
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  dir = *path == '/' || cwd == NULL ? dir_open_root () : dir_reopen (cwd);
+  if (dir == NULL)
+    return NULL;
+
+  result = get_next_part (name, &path);
+  if (result == 0)
+    {
+      strlcpy (name, ".", NAME_MAX + 1);
+      return dir;
+    }
+  while (result > 0)
+    {
+      char next[NAME_MAX + 1];
+      struct inode *inode;
+
+      result = get_next_part (next, &path);
+      if (result == 0)
+        return dir;
+      if (result < 0 || !dir_lookup (dir, name, &inode))
+        break;
+      if (!inode_is_dir (inode))
+        {
+          inode_close (inode);
+          break;
+        }
+      dir_close (dir);
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  dir_close (dir);
+  return NULL;
+}
+
+/* Opens the inode that PATH names.  Returns a null pointer if
+   there is none. */
+static struct inode *
+open_path (const char *path)
+{
+  char name[NAME_MAX + 1];
+  struct dir *dir = open_parent (path, name);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, name, &inode);
+  dir_close (dir);
+  return inode;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
 bool
-filesys_create (const char *name, off_t initial_size) 
+filesys_create (const char *name_, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char name[NAME_MAX + 1];
+  struct dir *dir = open_parent (name_, name);
+  bool success;
+
+  journal_begin ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
+  journal_end ();
+  dir_close (dir);
+
+  return success;
+}
+
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name_)
+{
+  block_sector_t inode_sector = 0;
+  char name[NAME_MAX + 1];
+  struct dir *dir = open_parent (name_, name);
+  bool success;
+
+  journal_begin ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && dir_create (inode_sector,
+                            inode_get_inumber (dir_get_inode (dir)))
+             && dir_add (dir, name, inode_sector));
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  journal_end ();
   dir_close (dir);
 
   return success;
@@ -66,38 +224,63 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
+  return file_open (open_path (name));
+}
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
+/* Makes the directory named NAME the current process's working
+   directory.  Returns true if successful, false if NAME does not
+   name a directory. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *cur = thread_current ();
+  struct inode *inode = open_path (name);
+  struct dir *dir;
 
-  return file_open (inode);
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  dir_close (cur->cwd);
+  cur->cwd = dir;
+  return true;
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
+   Fails if no file named NAME exists, if NAME is a directory
+   that is not empty or is in use,
    or if an internal memory allocation fails. */
 bool
-filesys_remove (const char *name) 
+filesys_remove (const char *name_) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char name[NAME_MAX + 1];
+  struct dir *dir = open_parent (name_, name);
+  bool success;
+
+  journal_begin ();
+  success = dir != NULL && dir_remove (dir, name);
+  journal_end ();
   dir_close (dir); 
 
   return success;
 }
-
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
+  journal_begin ();
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
+  journal_end ();
+  journal_commit ();
   free_map_close ();
   printf ("done.\n");
 }
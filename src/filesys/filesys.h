@@ -2,6 +2,7 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
@@ -11,10 +12,13 @@
 /* Block device that contains the file system. */
 extern struct block *fs_device;
 
-void filesys_init (bool format);
+void filesys_init (bool format, size_t cache_sectors);
 void filesys_done (void);
+void filesys_sync (void);
 bool filesys_create (const char *name, off_t initial_size);
+bool filesys_mkdir (const char *name);
 struct file *filesys_open (const char *name);
+bool filesys_chdir (const char *name);
 bool filesys_remove (const char *name);
 
 #endif /* filesys/filesys.h */
@@ -1,52 +1,408 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <list.h>
+#include <radix.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors of the free map file that changed since they were last
+   written, one bit per sector.  Allocation and release only mark
+   sectors here; free_map_flush() writes them. */
+static struct bitmap *dirty_sectors;
+
+/* Free map bits held by one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* Guards free_map, dirty_sectors, the free extent index and the
+   released extents below. */
+static struct lock free_map_lock;
+
+/* A maximal run of free sectors. */
+struct extent
+  {
+    block_sector_t start;               /* First free sector. */
+    size_t length;                      /* Number of free sectors. */
+    struct list_elem elem;              /* Element in size_classes[]. */
+  };
+
+/* Free extents, indexed three ways: by size class, the floor of
+   the base-2 logarithm of the length, to find one big enough; by
+   first sector, to find one at a goal; and by last sector,
+   together with by first sector to merge a released run with
+   its neighbours.  Kept in step with free_map, which is what
+   goes to disk. */
+#define SIZE_CLASS_CNT 32
+static struct list size_classes[SIZE_CLASS_CNT];
+static struct radix_tree by_start;
+static struct radix_tree by_end;
+
+/* Released sectors are kept out of the index until the journal
+   has written in place the transaction that released them, so
+   that no sector is overwritten as file data while metadata on
+   disk may still point to it.  Extents released since the last
+   free_map_flush() are pending; free_map_flush() makes them
+   flushed, and free_map_release_flushed() indexes them. */
+static struct list pending_extents;
+static struct list flushed_extents;
+
+/* Extents of a size class examined for the one nearest a goal. */
+#define NEAR_SCAN_MAX 16
+
+/* Returns the size class of an extent LENGTH sectors long. */
+static int
+size_class (size_t length)
+{
+  int class = 0;
+  while (length >>= 1)
+    class++;
+  return class;
+}
+
+/* Adds E to the free extent index. */
+static void
+index_insert (struct extent *e)
+{
+  list_push_back (&size_classes[size_class (e->length)], &e->elem);
+  if (!radix_insert (&by_start, e->start, e)
+      || !radix_insert (&by_end, e->start + e->length - 1, e))
+    PANIC ("free extent index out of memory");
+}
+
+/* Removes E from the free extent index. */
+static void
+index_remove (struct extent *e)
+{
+  list_remove (&e->elem);
+  radix_delete (&by_start, e->start);
+  radix_delete (&by_end, e->start + e->length - 1);
+}
+
+/* Adds the CNT sectors starting at START to the free extent
+   index, merging them with the free extents just before and
+   just after. */
+static void
+add_extent (block_sector_t start, size_t cnt)
+{
+  struct extent *prev = start > 0 ? radix_lookup (&by_end, start - 1) : NULL;
+  struct extent *next = radix_lookup (&by_start, start + cnt);
+  struct extent *e;
+
+  if (prev != NULL)
+    {
+      index_remove (prev);
+      start = prev->start;
+      cnt += prev->length;
+      free (prev);
+    }
+  if (next != NULL)
+    {
+      index_remove (next);
+      cnt += next->length;
+      free (next);
+    }
+
+  e = malloc (sizeof *e);
+  if (e == NULL)
+    PANIC ("free extent index out of memory");
+  e->start = start;
+  e->length = cnt;
+  index_insert (e);
+}
+
+/* Removes up to CNT sectors from the front of free extent E and
+   marks them used.  Returns the number taken. */
+static size_t
+take_extent (struct extent *e, size_t cnt)
+{
+  if (cnt > e->length)
+    cnt = e->length;
+  bitmap_set_multiple (free_map, e->start, cnt, true);
+  index_remove (e);
+  if (cnt < e->length)
+    {
+      e->start += cnt;
+      e->length -= cnt;
+      index_insert (e);
+    }
+  else
+    free (e);
+  return cnt;
+}
+
+/* Returns the distance between sectors A and B. */
+static block_sector_t
+distance (block_sector_t a, block_sector_t b)
+{
+  return a > b ? a - b : b - a;
+}
+
+/* Finds a free extent of at least CNT sectors: the one starting
+   right at GOAL if there is one, otherwise one from the smallest
+   size class that has one, preferring among the first few the
+   one nearest GOAL.  Returns a null pointer if no free extent is
+   that long. */
+static struct extent *
+find_extent (size_t cnt, block_sector_t goal)
+{
+  struct extent *e = radix_lookup (&by_start, goal);
+  int class;
+
+  if (e != NULL && e->length >= cnt)
+    return e;
+  for (class = size_class (cnt); class < SIZE_CLASS_CNT; class++)
+    {
+      struct list *list = &size_classes[class];
+      struct extent *best = NULL;
+      struct list_elem *elem;
+      int scanned = 0;
+
+      for (elem = list_begin (list); elem != list_end (list);
+           elem = list_next (elem))
+        {
+          e = list_entry (elem, struct extent, elem);
+          if (e->length < cnt)
+            continue;
+          if (best == NULL
+              || distance (e->start, goal) < distance (best->start, goal))
+            best = e;
+          if (++scanned >= NEAR_SCAN_MAX)
+            break;
+        }
+      if (best != NULL)
+        return best;
+    }
+  return NULL;
+}
+
+/* Returns the longest free extent, or a null pointer if the disk
+   is full. */
+static struct extent *
+largest_extent (void)
+{
+  struct extent *best = NULL;
+  int class;
+
+  for (class = SIZE_CLASS_CNT - 1; class >= 0 && best == NULL; class--)
+    {
+      struct list *list = &size_classes[class];
+      struct list_elem *elem;
+
+      for (elem = list_begin (list); elem != list_end (list);
+           elem = list_next (elem))
+        {
+          struct extent *e = list_entry (elem, struct extent, elem);
+          if (best == NULL || e->length > best->length)
+            best = e;
+        }
+    }
+  return best;
+}
+
+/* Rebuilds the free extent index from free_map. */
+static void
+build_index (void)
+{
+  size_t sector_cnt = bitmap_size (free_map);
+  size_t start, end;
+  struct extent *e;
+  int class;
+
+  while ((e = radix_first (&by_start, &start)) != NULL)
+    {
+      index_remove (e);
+      free (e);
+    }
+  for (class = 0; class < SIZE_CLASS_CNT; class++)
+    list_init (&size_classes[class]);
+
+  for (start = 0;
+       (start = bitmap_scan (free_map, start, 1, false)) != BITMAP_ERROR;
+       start = end)
+    {
+      for (end = start; end < sector_cnt && !bitmap_test (free_map, end); end++)
+        continue;
+      add_extent (start, end - start);
+    }
+}
+
+/* Notes that the bits of the CNT sectors starting at START
+   changed. */
+static void
+mark_dirty (block_sector_t start, size_t cnt)
+{
+  size_t first = start / BITS_PER_SECTOR;
+  size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
+}
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  block_sector_t start;
+  size_t cnt;
+  int class;
+
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+
+  for (class = 0; class < SIZE_CLASS_CNT; class++)
+    list_init (&size_classes[class]);
+  radix_init (&by_start);
+  radix_init (&by_end);
+  list_init (&pending_extents);
+  list_init (&flushed_extents);
+  journal_region (&start, &cnt);
+  bitmap_set_multiple (free_map, start, cnt, true);
+  build_index ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Takes them from the smallest size
+   class of free extents that can hold them.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  struct extent *e;
+
+  lock_acquire (&free_map_lock);
+  e = find_extent (cnt, 0);
+  if (e != NULL)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      *sectorp = e->start;
+      take_extent (e, cnt);
+      mark_dirty (*sectorp, cnt);
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  lock_release (&free_map_lock);
+  return e != NULL;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates up to CNT consecutive sectors, as close to sector
+   GOAL as possible, and stores the first into *SECTORP.  If no
+   run of CNT sectors is free, allocates the longest run there
+   is.  Returns the number of sectors allocated, 0 if the disk is
+   full. */
+size_t
+free_map_allocate_near (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
+{
+  struct extent *e;
+
+  lock_acquire (&free_map_lock);
+  e = find_extent (cnt, goal);
+  if (e == NULL)
+    e = largest_extent ();
+  if (e != NULL)
+    {
+      *sectorp = e->start;
+      cnt = take_extent (e, cnt);
+      mark_dirty (*sectorp, cnt);
+    }
+  else
+    cnt = 0;
+  lock_release (&free_map_lock);
+  return cnt;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, once
+   the journal has committed their release. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  struct extent *e = malloc (sizeof *e);
+  if (e == NULL)
+    PANIC ("free extent index out of memory");
+  e->start = sector;
+  e->length = cnt;
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  list_push_back (&pending_extents, &e->elem);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Makes the sectors released before the last free_map_flush()
+   available for allocation.  Called by the journal once the
+   transaction holding that flush is in place. */
+void
+free_map_release_flushed (void)
+{
+  lock_acquire (&free_map_lock);
+  while (!list_empty (&flushed_extents))
+    {
+      struct extent *e = list_entry (list_pop_front (&flushed_extents),
+                                     struct extent, elem);
+      add_extent (e->start, e->length);
+      free (e);
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that changed since
+   they were last written, through the buffer cache, and makes
+   the sectors released so far flushed.  Each sector is copied
+   with free_map_lock held but written without it, since the
+   write may wait on the journal while allocations go on.  Does
+   nothing before the free map file is open. */
+void
+free_map_flush (void)
+{
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  struct file *file;
+  size_t file_size, sector;
+
+  lock_acquire (&free_map_lock);
+  file = free_map_file != NULL ? file_reopen (free_map_file) : NULL;
+  if (file == NULL)
+    {
+      lock_release (&free_map_lock);
+      return;
+    }
+  while (!list_empty (&pending_extents))
+    list_push_back (&flushed_extents, list_pop_front (&pending_extents));
+  file_size = bitmap_file_size (free_map);
+  for (sector = 0;
+       (sector = bitmap_scan (dirty_sectors, sector, 1, true)) != BITMAP_ERROR;
+       sector++)
+    {
+      size_t ofs = sector * BLOCK_SECTOR_SIZE;
+      size_t size = file_size - ofs;
+      bool written;
+
+      if (size > BLOCK_SECTOR_SIZE)
+        size = BLOCK_SECTOR_SIZE;
+      bitmap_copy_bytes (free_map, buffer, ofs, size);
+      bitmap_reset (dirty_sectors, sector);
+      lock_release (&free_map_lock);
+      written = (inode_write_at (file_get_inode (file), buffer, size, ofs)
+                 == (off_t) size);
+      lock_acquire (&free_map_lock);
+      if (!written)
+        bitmap_mark (dirty_sectors, sector);
+    }
+  lock_release (&free_map_lock);
+  file_close (file);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +414,21 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty_sectors, false);
+  build_index ();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file.  The free map reaches the disk
+   through the journal, so the caller must first commit it with
+   journal_commit(), which also lets sectors released so far be
+   reused. */
 void
 free_map_close (void) 
 {
+  lock_acquire (&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -73,7 +437,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -82,4 +446,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_sectors, false);
 }
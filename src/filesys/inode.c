@@ -1,23 +1,51 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <hash.h>
+#include <radix.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "vm/frame.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector pointers held directly in the inode, and in each
+   indirect sector. */
+#define DIRECT_CNT 123
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Most bytes inode_write_at() writes in one journal operation,
+   so that no operation logs more sectors than the journal keeps
+   room for. */
+#define WRITE_PIECE (64 * BLOCK_SECTOR_SIZE)
+
+/* Data sectors in the largest file. */
+#define MAX_DATA_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                          + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a multi-level index: the first
+   DIRECT_CNT through DIRECT, the next PTRS_PER_SECTOR through the
+   sector that INDIRECT points to, and the rest through the
+   sectors of pointers that DOUBLY_INDIRECT points to.  A pointer
+   of 0 means that no sector was allocated yet, since sector 0
+   always holds the free map inode. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Sector of data sector pointers. */
+    block_sector_t doubly_indirect;     /* Sector of indirect sectors. */
+    uint32_t is_dir;                    /* Nonzero for a directory. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,19 +56,73 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   Readers of the file's data hold RWLOCK for reading; writers,
+   who may also extend the file, hold it for writing, so that
+   readers see either none or all of a write and its new length.
+   Writes also wait for readers of the same file to finish, but
+   files do not wait for one another. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* Guards data and deny_write_cnt. */
+    struct lock dir_lock;               /* Guards entries, if a directory. */
     struct inode_disk data;             /* Inode content. */
+    struct radix_tree pages;            /* Cached pages, by page index. */
   };
 
+/* Returns pointer SLOT of the indirect sector SECTOR. */
+static block_sector_t
+read_ptr (block_sector_t sector, size_t slot)
+{
+  block_sector_t ptr;
+  cache_read (sector, &ptr, slot * sizeof ptr, sizeof ptr);
+  return ptr;
+}
+
+/* Sets pointer SLOT of the indirect sector SECTOR to PTR. */
+static void
+write_ptr (block_sector_t sector, size_t slot, block_sector_t ptr)
+{
+  cache_write_meta (sector, &ptr, slot * sizeof ptr, sizeof ptr);
+}
+
+/* Returns true if the data of the file that DISK, stored in
+   sector INODE_SECTOR, describes is itself metadata, to be
+   journaled: a directory's entries or the free map. */
+static bool
+holds_metadata (const struct inode_disk *disk, block_sector_t inode_sector)
+{
+  return disk->is_dir || inode_sector == FREE_MAP_SECTOR;
+}
+
+/* Returns the data sector with index IDX within the file that
+   DISK describes, or 0 if it is not allocated.  Takes at most
+   two reads of index sectors, both usually cached. */
+static block_sector_t
+index_to_sector (const struct inode_disk *disk, size_t idx)
+{
+  block_sector_t sector;
+
+  if (idx < DIRECT_CNT)
+    return disk->direct[idx];
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    return disk->indirect != 0 ? read_ptr (disk->indirect, idx) : 0;
+  idx -= PTRS_PER_SECTOR;
+  if (disk->doubly_indirect == 0 || idx >= PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    return 0;
+  sector = read_ptr (disk->doubly_indirect, idx / PTRS_PER_SECTOR);
+  return sector != 0 ? read_ptr (sector, idx % PTRS_PER_SECTOR) : 0;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, or 0 if that part of INODE was never written.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
@@ -48,29 +130,226 @@ byte_to_sector (const struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return index_to_sector (&inode->data, pos / BLOCK_SECTOR_SIZE);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Allocates a zeroed sector into *SECTOR if *SECTOR is 0.
+   Returns false if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *sector)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (*sector != 0)
+    return true;
+  if (!free_map_allocate (1, sector))
+    return false;
+  cache_write_meta (*sector, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Allocates pointer SLOT of the indirect sector SECTOR, zeroed,
+   if it is still 0, and returns it, or 0 if the disk is full. */
+static block_sector_t
+allocate_ptr (block_sector_t sector, size_t slot)
+{
+  block_sector_t ptr = read_ptr (sector, slot);
+  if (ptr == 0)
+    {
+      if (!allocate_zeroed (&ptr))
+        return 0;
+      write_ptr (sector, slot, ptr);
+    }
+  return ptr;
+}
+
+/* Records SECTOR as the data sector with index IDX within the
+   file that DISK describes, allocating the index sectors leading
+   to it, zeroed, as needed.  Returns false if the disk is full or
+   IDX is beyond the largest file size. */
+static bool
+set_index (struct inode_disk *disk, size_t idx, block_sector_t sector)
+{
+  block_sector_t ptrs;
+
+  if (idx < DIRECT_CNT)
+    {
+      disk->direct[idx] = sector;
+      return true;
+    }
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    {
+      if (!allocate_zeroed (&disk->indirect))
+        return false;
+      write_ptr (disk->indirect, idx, sector);
+      return true;
+    }
+  idx -= PTRS_PER_SECTOR;
+  if (idx >= PTRS_PER_SECTOR * PTRS_PER_SECTOR
+      || !allocate_zeroed (&disk->doubly_indirect))
+    return false;
+  ptrs = allocate_ptr (disk->doubly_indirect, idx / PTRS_PER_SECTOR);
+  if (ptrs == 0)
+    return false;
+  write_ptr (ptrs, idx % PTRS_PER_SECTOR, sector);
+  return true;
+}
+
+/* Returns true if bytes OFFSET through OFFSET + SIZE - 1 lie
+   within the file that DISK describes and the data sectors
+   holding them are all allocated, so that writing them changes
+   no metadata. */
+static bool
+is_allocated (const struct inode_disk *disk, off_t offset, off_t size)
+{
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  size_t end = bytes_to_sectors (offset + size);
+
+  if (offset + size > disk->length)
+    return false;
+  for (; idx < end; idx++)
+    if (index_to_sector (disk, idx) == 0)
+      return false;
+  return true;
+}
+
+/* Allocates the data sectors holding bytes OFFSET through OFFSET
+   + SIZE - 1 of the file that DISK, stored in sector
+   INODE_SECTOR, describes, where they are not allocated yet, and
+   grows the file to cover them.  Other sectors stay unallocated,
+   reading as zeros, until they are written.  Each missing
+   stretch of sectors is asked of the free map as one run, placed
+   right after the sector before it, or after the inode if there
+   is none, so that a file written sequentially lands
+   contiguously on disk.  New sectors are zeroed, through the
+   journal if they hold metadata, since a write may cover only
+   part of one.  Returns false if the disk fills up, in which case
+   the length is unchanged but the sectors allocated so far stay
+   in the index, to be reused by the next attempt or freed with
+   the file. */
+static bool
+allocate (struct inode_disk *disk, block_sector_t inode_sector,
+          off_t offset, off_t size)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  size_t end = bytes_to_sectors (offset + size);
+  bool meta = holds_metadata (disk, inode_sector);
+
+  while (idx < end)
+    {
+      block_sector_t prev, goal, start;
+      size_t missing, cnt, i;
+
+      if (index_to_sector (disk, idx) != 0)
+        {
+          idx++;
+          continue;
+        }
+
+      for (missing = 1; idx + missing < end; missing++)
+        if (index_to_sector (disk, idx + missing) != 0)
+          break;
+      prev = idx > 0 ? index_to_sector (disk, idx - 1) : 0;
+      goal = prev != 0 ? prev + 1 : inode_sector + 1;
+      cnt = free_map_allocate_near (missing, goal, &start);
+      if (cnt == 0)
+        return false;
+      for (i = 0; i < cnt; i++)
+        {
+          if (!set_index (disk, idx + i, start + i))
+            {
+              free_map_release (start + i, cnt - i);
+              return false;
+            }
+          if (meta)
+            cache_write_meta (start + i, zeros, 0, BLOCK_SECTOR_SIZE);
+          else
+            cache_write (start + i, zeros, 0, BLOCK_SECTOR_SIZE);
+        }
+      idx += cnt;
+    }
+  if (offset + size > disk->length)
+    disk->length = offset + size;
+  return true;
+}
+
+/* Releases the sectors of pointers in SECTOR, descending LEVELS
+   further levels of indirection, and then SECTOR itself. */
+static void
+release_indirect (block_sector_t sector, int levels)
+{
+  size_t i;
+
+  if (levels > 0)
+    for (i = 0; i < PTRS_PER_SECTOR; i++)
+      {
+        block_sector_t ptr = read_ptr (sector, i);
+        if (ptr != 0)
+          release_indirect (ptr, levels - 1);
+      }
+  free_map_release (sector, 1);
+}
+
+/* Releases every data and index sector of the file that DISK
+   describes. */
+static void
+release_sectors (const struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_release (disk->direct[i], 1);
+  if (disk->indirect != 0)
+    release_indirect (disk->indirect, 1);
+  if (disk->doubly_indirect != 0)
+    release_indirect (disk->doubly_indirect, 2);
+}
+
+/* Open inodes, by sector, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+
+/* Guards open_inodes and the open_cnt of every open inode, so
+   that an inode found in the table cannot be freed by a
+   concurrent last close before it is reopened. */
+static struct lock open_inodes_lock;
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Initializes an inode with LENGTH bytes of data, for a
+   directory if IS_DIR, and writes the new inode to sector SECTOR
+   on the file system device.  No data sector is allocated until
+   it is written; until then it reads as zeros.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is beyond
+   the largest file size. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -84,20 +363,12 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      disk_inode->length = length;
+      if (bytes_to_sectors (length) <= MAX_DATA_SECTORS) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          cache_write_meta (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
           success = true; 
         } 
       free (disk_inode);
@@ -111,33 +382,43 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The lock stays held until the inode is read in,
+     so that no other opener sees it half done. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->dir_lock);
+  radix_init (&inode->pages);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +427,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,28 +448,70 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      pcache_drop_inode (inode);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          journal_begin ();
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
+          journal_end ();
         }
 
       free (inode); 
     }
 }
 
+/* Returns the page cache of INODE's data, which maps page
+   indexes to frames. */
+struct radix_tree *
+inode_pages (struct inode *inode)
+{
+  return &inode->pages;
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir;
+}
+
+/* Returns true if INODE was removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (const struct inode *inode)
+{
+  int cnt;
+
+  lock_acquire (&open_inodes_lock);
+  cnt = inode->open_cnt;
+  lock_release (&open_inodes_lock);
+  return cnt;
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void
@@ -196,13 +523,27 @@ inode_remove (struct inode *inode)
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.  The
+   sector after the last one read is read ahead. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  off_t bytes_read;
+
+  rwlock_acquire_read (&inode->rwlock);
+  bytes_read = inode_read_at_locked (inode, buffer, size, offset);
+  rwlock_release_read (&inode->rwlock);
+  return bytes_read;
+}
+
+/* Like inode_read_at(), for a caller that already holds INODE's
+   lock shared through inode_lock_shared(). */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at_locked (struct inode *inode, void *buffer_, off_t size,
+                      off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
@@ -211,7 +552,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,59 +561,69 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
+  /* Fetch the next sector in the background for a sequential
+     reader. */
+  offset = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+  if (bytes_read > 0 && offset < inode->data.length)
+    {
+      block_sector_t next = byte_to_sector (inode, offset);
+      if (next != 0)
+        cache_read_ahead (next);
+    }
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+/* Writes one piece of at most WRITE_PIECE bytes for
+   inode_write_at(), in a journal operation of its own unless the
+   caller is already in one.  Pages of INODE in the page cache are
+   updated under the same lock, so that they end up holding the
+   same bytes as the disk however writers race. */
+static off_t
+write_piece (struct inode *inode, const void *buffer_, off_t size,
+             off_t offset) 
 {
   const uint8_t *buffer = buffer_;
+  off_t start = offset;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
-
-  if (inode->deny_write_cnt)
-    return 0;
+  bool meta = holds_metadata (&inode->data, inode->sector);
+  bool journaled, writable;
+
+  /* Files only grow, and their sectors stay allocated while they
+     are open, so a write found here to need no allocation will
+     not need any below either.  The journal comes before the
+     inode lock, in keeping with file system calls that begin a
+     journal operation and then lock directories and inodes. */
+  journaled = meta || (size > 0 && !is_allocated (&inode->data, offset, size));
+  if (journaled)
+    journal_begin ();
+  rwlock_acquire_write (&inode->rwlock);
+
+  writable = inode->deny_write_cnt == 0;
+  if (writable && size > 0 && !is_allocated (&inode->data, offset, size))
+    {
+      writable = allocate (&inode->data, inode->sector, offset, size);
+      cache_write_meta (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
 
-  while (size > 0) 
+  while (writable && size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,49 +632,63 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      if (meta)
+        cache_write_meta (sector_idx, buffer + bytes_written, sector_ofs,
+                          chunk_size);
+      else
+        cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                     chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+  pcache_update (inode, buffer, bytes_written, start);
+  rwlock_release_write (&inode->rwlock);
+  if (journaled)
+    journal_end ();
 
   return bytes_written;
 }
 
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or an error occurs.
+   A write past end of file first extends the inode, leaving any
+   gap unallocated, to read as zeros.  Changes to metadata are
+   journaled.  A write larger than WRITE_PIECE is done, and seen
+   by readers, one piece at a time. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  while (size > 0)
+    {
+      off_t piece = size < WRITE_PIECE ? size : WRITE_PIECE;
+      off_t n = write_piece (inode, buffer + bytes_written, piece, offset);
+
+      bytes_written += n;
+      offset += n;
+      size -= n;
+      if (n < piece)
+        break;
+    }
+  return bytes_written;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +697,48 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  Files only
+   grow, so the value read without the lock is at worst a little
+   stale. */
 off_t
 inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Acquires INODE's data lock shared, keeping writes to INODE out
+   until inode_unlock_shared(). */
+void
+inode_lock_shared (struct inode *inode)
+{
+  rwlock_acquire_read (&inode->rwlock);
+}
+
+/* Releases INODE's data lock taken by inode_lock_shared(). */
+void
+inode_unlock_shared (struct inode *inode)
+{
+  rwlock_release_read (&inode->rwlock);
+}
+
+/* Acquires the lock on the entries of directory INODE. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  ASSERT (inode_is_dir (inode));
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the lock on the entries of directory INODE. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
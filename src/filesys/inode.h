@@ -6,18 +6,28 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct radix_tree;
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_dir (const struct inode *);
+bool inode_is_removed (const struct inode *);
+int inode_open_cnt (const struct inode *);
+struct radix_tree *inode_pages (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_at_locked (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_lock_shared (struct inode *);
+void inode_unlock_shared (struct inode *);
+void inode_lock_dir (struct inode *);
+void inode_unlock_dir (struct inode *);
 
 #endif /* filesys/inode.h */
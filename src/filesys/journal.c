@@ -0,0 +1,572 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead metadata journal.
+
+   Every write of file system metadata (inodes, index sectors,
+   directories and the free map) goes through the buffer cache
+   with cache_write_meta(), which hands a copy of the whole
+   sector to journal_log().  The copies made since the last commit
+   form the running transaction.  The cache does not write a
+   sector back in place until the transaction that last changed
+   it has been committed.
+
+   Every file system operation that changes metadata runs between
+   journal_begin() and journal_end().  To commit, the commit
+   thread waits until no operation is in progress, so that a
+   transaction only ever holds whole operations, and flushes the
+   free map into it.  Then it starts a new running transaction
+   and lets operations continue while it writes the old one to
+   the log region at the end of fs_device, all in one sequential
+   run: descriptor sectors naming the home sector of each copy,
+   the copies, and a commit sector.  Then it writes the copies in
+   place and records in the log header that the log is empty
+   again.  On the next boot, journal_init() redoes a transaction
+   that was committed but not yet recorded as written in place.
+
+   A transaction is always written in a single pass, so that it
+   takes effect entirely or not at all.  To keep it small enough,
+   journal_begin() reserves room for OP_MAX sectors for each
+   operation in progress, plus the free map flushed at commit,
+   and waits for a commit instead of starting an operation that
+   might overflow the log. */
+
+/* Most sectors that one operation logs.  inode_write_at() logs
+   at most WRITE_PIECE bytes of data and the index sectors above
+   them per operation, and adding a name to a directory rewrites
+   at most its header, its 64 table blocks, a few buckets and its
+   index sectors. */
+#define OP_MAX 128
+
+/* Milliseconds between group commits, at most. */
+#define COMMIT_INTERVAL_MS 1000
+
+/* Magic numbers of the log's header, descriptor and commit
+   sectors. */
+#define HEADER_MAGIC 0x4a524e4c
+#define DESC_MAGIC 0x4a444553
+#define COMMIT_MAGIC 0x4a434d54
+
+/* Home sectors named by one descriptor sector. */
+#define DESC_SECTORS 125
+
+/* First sector of the log region. */
+struct log_header
+  {
+    uint32_t magic;                     /* HEADER_MAGIC. */
+    uint32_t next_seq;                  /* Sequence of the next pass. */
+    uint32_t sector_cnt;                /* Size of the log region. */
+    uint8_t unused[500];                /* Not used. */
+  };
+
+/* Names the home sectors of the copies that follow it. */
+struct log_desc
+  {
+    uint32_t magic;                     /* DESC_MAGIC. */
+    uint32_t seq;                       /* Sequence of its pass. */
+    uint32_t cnt;                       /* Number of sectors named. */
+    block_sector_t sectors[DESC_SECTORS];
+  };
+
+/* Ends a pass.  A pass without one never took effect. */
+struct log_commit
+  {
+    uint32_t magic;                     /* COMMIT_MAGIC. */
+    uint32_t seq;                       /* Sequence of its pass. */
+    uint32_t cnt;                       /* Copies in the pass. */
+    uint8_t unused[500];                /* Not used. */
+  };
+
+/* The latest copy of a sector in a transaction. */
+struct image
+  {
+    struct hash_elem elem;              /* Element in txn's images. */
+    block_sector_t sector;              /* Home sector. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Contents. */
+  };
+
+/* A transaction. */
+struct txn
+  {
+    unsigned id;                        /* Identifier, counting from 1. */
+    struct hash images;                 /* Sector copies, by sector. */
+  };
+
+static block_sector_t log_start;        /* Header sector of the log. */
+static size_t log_cnt;                  /* Sectors in the log region. */
+static size_t pass_max;                 /* Most copies in one pass. */
+static size_t map_sectors;              /* Sectors of the free map. */
+static uint32_t next_seq;               /* Sequence of the next pass. */
+
+/* Guards everything below. */
+static struct lock journal_lock;
+static struct txn txns[2];
+static struct txn *running;             /* Taking new copies. */
+static struct txn *committing;          /* Being written, or empty. */
+static unsigned committed_id;           /* Last transaction in place. */
+static int active_cnt;                  /* Operations in progress. */
+static bool draining;                   /* A commit waits for quiet. */
+static bool commit_wanted;              /* Commit thread should run. */
+static struct condition drained;        /* Signaled when active_cnt is 0. */
+static struct condition may_begin;      /* Broadcast when !draining. */
+static struct condition commit_ready;   /* Signaled for commit_wanted. */
+
+/* Serializes commits. */
+static struct lock commit_lock;
+
+static void replay (void);
+static void commit_daemon (void *aux);
+
+static unsigned
+image_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct image, elem)->sector);
+}
+
+static bool
+image_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct image, elem)->sector
+          < hash_entry (b, struct image, elem)->sector);
+}
+
+static void
+image_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct image, elem));
+}
+
+/* Sets up the journal in the log region of fs_device, which is
+   written afresh if FORMAT is true, or otherwise replayed, and
+   starts the commit thread. */
+void
+journal_init (bool format)
+{
+  struct log_header *header;
+  size_t min_copies, avail;
+
+  ASSERT (sizeof (struct log_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct log_desc) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct log_commit) == BLOCK_SECTOR_SIZE);
+
+  /* One sixteenth of the disk, within reason, but enough for two
+     operations and the free map in one pass.  Besides the header
+     and the commit sector, each descriptor takes one sector per
+     DESC_SECTORS copies. */
+  map_sectors = DIV_ROUND_UP (DIV_ROUND_UP (block_size (fs_device), 8),
+                              BLOCK_SECTOR_SIZE);
+  min_copies = 2 * OP_MAX + map_sectors;
+  log_cnt = block_size (fs_device) / 16;
+  if (log_cnt > 1024)
+    log_cnt = 1024;
+  if (log_cnt < min_copies + DIV_ROUND_UP (min_copies, DESC_SECTORS) + 2)
+    log_cnt = min_copies + DIV_ROUND_UP (min_copies, DESC_SECTORS) + 2;
+  if (log_cnt > block_size (fs_device) / 2)
+    PANIC ("file system device too small for its journal");
+  log_start = block_size (fs_device) - log_cnt;
+
+  avail = log_cnt - 2;
+  pass_max = avail / (DESC_SECTORS + 1) * DESC_SECTORS;
+  if (avail % (DESC_SECTORS + 1) > 1)
+    pass_max += avail % (DESC_SECTORS + 1) - 1;
+  ASSERT (pass_max >= min_copies);
+
+  header = calloc (1, sizeof *header);
+  if (header == NULL)
+    PANIC ("can't allocate journal header");
+  if (format)
+    {
+      header->magic = HEADER_MAGIC;
+      header->next_seq = 1;
+      header->sector_cnt = log_cnt;
+      block_write (fs_device, log_start, header);
+    }
+  else
+    {
+      block_read (fs_device, log_start, header);
+      if (header->magic != HEADER_MAGIC || header->sector_cnt != log_cnt)
+        PANIC ("file system has no journal--reformat it");
+    }
+  next_seq = header->next_seq;
+  free (header);
+  if (!format)
+    replay ();
+
+  lock_init (&journal_lock);
+  lock_init (&commit_lock);
+  cond_init (&drained);
+  cond_init (&may_begin);
+  cond_init (&commit_ready);
+  txns[0].id = 1;
+  hash_init (&txns[0].images, image_hash, image_less, NULL);
+  hash_init (&txns[1].images, image_hash, image_less, NULL);
+  running = &txns[0];
+  committing = &txns[1];
+  thread_create ("journal", PRI_DEFAULT, commit_daemon, NULL);
+}
+
+/* Stores the first sector and the size of the log region, which
+   the free map must keep out of use. */
+void
+journal_region (block_sector_t *start, size_t *cnt)
+{
+  *start = log_start;
+  *cnt = log_cnt;
+}
+
+/* Records next_seq in the log header. */
+static void
+write_header (void)
+{
+  struct log_header *header = calloc (1, sizeof *header);
+  if (header == NULL)
+    PANIC ("can't allocate journal header");
+  header->magic = HEADER_MAGIC;
+  header->next_seq = next_seq;
+  header->sector_cnt = log_cnt;
+  block_write (fs_device, log_start, header);
+  free (header);
+}
+
+/* Redoes the pass at the start of the log if it was committed
+   but not recorded as written in place. */
+static void
+replay (void)
+{
+  struct log_desc *desc = malloc (sizeof *desc);
+  uint8_t *data = malloc (BLOCK_SECTOR_SIZE);
+  block_sector_t pos = log_start + 1;
+  block_sector_t end = log_start + log_cnt;
+  size_t cnt = 0, i;
+  bool committed = false;
+
+  if (desc == NULL || data == NULL)
+    PANIC ("can't allocate journal buffers");
+
+  /* Find the commit sector, checking the descriptors on the
+     way. */
+  while (pos < end)
+    {
+      block_read (fs_device, pos, desc);
+      if (desc->magic == COMMIT_MAGIC)
+        {
+          committed = desc->seq == next_seq && desc->cnt == cnt;
+          break;
+        }
+      if (desc->magic != DESC_MAGIC || desc->seq != next_seq
+          || desc->cnt > DESC_SECTORS)
+        break;
+      cnt += desc->cnt;
+      pos += 1 + desc->cnt;
+    }
+
+  if (committed)
+    {
+      printf ("Replaying file system journal...");
+      for (pos = log_start + 1; cnt > 0; cnt -= desc->cnt)
+        {
+          block_read (fs_device, pos++, desc);
+          for (i = 0; i < desc->cnt; i++)
+            {
+              block_read (fs_device, pos++, data);
+              block_write (fs_device, desc->sectors[i], data);
+            }
+        }
+      next_seq++;
+      write_header ();
+      printf ("done.\n");
+    }
+  free (data);
+  free (desc);
+}
+
+/* Returns true if the running transaction has room for OP_CNT
+   operations of OP_MAX sectors each, besides the free map.  Must
+   hold journal_lock. */
+static bool
+has_room (int op_cnt)
+{
+  return (hash_size (&running->images) + op_cnt * OP_MAX + map_sectors
+          <= pass_max);
+}
+
+/* Asks the commit thread to commit the running transaction once
+   it has no room for another operation.  Must hold
+   journal_lock. */
+static void
+commit_if_full (void)
+{
+  if (!has_room (1) && !commit_wanted)
+    {
+      commit_wanted = true;
+      cond_signal (&commit_ready, &journal_lock);
+    }
+}
+
+/* Starts a file system operation that may change metadata.  Waits
+   while a commit waits for quiet, or until the running
+   transaction has room for this operation along with those in
+   progress.  Operations nest, and only the outermost one
+   counts. */
+void
+journal_begin (void)
+{
+  if (thread_current ()->journal_depth++ > 0)
+    return;
+  lock_acquire (&journal_lock);
+  while (draining || !has_room (active_cnt + 1))
+    {
+      commit_if_full ();
+      cond_wait (&may_begin, &journal_lock);
+    }
+  active_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends the operation started by journal_begin().  Asks for a
+   commit if the running transaction has no room for another
+   operation. */
+void
+journal_end (void)
+{
+  ASSERT (thread_current ()->journal_depth > 0);
+  if (--thread_current ()->journal_depth > 0)
+    return;
+  lock_acquire (&journal_lock);
+  if (--active_cnt == 0)
+    cond_signal (&drained, &journal_lock);
+  cond_broadcast (&may_begin, &journal_lock);
+  commit_if_full ();
+  lock_release (&journal_lock);
+}
+
+/* Adds a copy of SECTOR, whose contents are now DATA, to the
+   running transaction, and returns the transaction's
+   identifier. */
+unsigned
+journal_log (block_sector_t sector, const void *data)
+{
+  struct image key, *image;
+  struct hash_elem *e;
+  unsigned id;
+
+  lock_acquire (&journal_lock);
+  key.sector = sector;
+  e = hash_find (&running->images, &key.elem);
+  if (e != NULL)
+    image = hash_entry (e, struct image, elem);
+  else
+    {
+      image = malloc (sizeof *image);
+      if (image == NULL)
+        PANIC ("out of memory for the journal");
+      image->sector = sector;
+      hash_insert (&running->images, &image->elem);
+    }
+  memcpy (image->data, data, BLOCK_SECTOR_SIZE);
+  id = running->id;
+  lock_release (&journal_lock);
+  return id;
+}
+
+/* Copies the latest contents of SECTOR that are not yet in place
+   into DATA and returns true, or returns false if the disk
+   already holds them. */
+bool
+journal_read (block_sector_t sector, void *data)
+{
+  struct image key;
+  struct hash_elem *e;
+
+  lock_acquire (&journal_lock);
+  key.sector = sector;
+  e = hash_find (&running->images, &key.elem);
+  if (e == NULL)
+    e = hash_find (&committing->images, &key.elem);
+  if (e != NULL)
+    memcpy (data, hash_entry (e, struct image, elem)->data,
+            BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+  return e != NULL;
+}
+
+/* Returns true if transaction TXN was committed and written in
+   place, so that the sectors it changed may be written back. */
+bool
+journal_committed (unsigned txn)
+{
+  bool committed;
+
+  lock_acquire (&journal_lock);
+  committed = txn <= committed_id;
+  lock_release (&journal_lock);
+  return committed;
+}
+
+/* Asks the commit thread to commit the running transaction soon. */
+void
+journal_request_commit (void)
+{
+  lock_acquire (&journal_lock);
+  commit_wanted = true;
+  cond_signal (&commit_ready, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Writes the CNT copies in IMAGES to the log as one pass and, if
+   IN_PLACE, then in place, after which it empties the log. */
+static void
+write_pass (struct image **images, size_t cnt, bool in_place)
+{
+  struct log_desc *desc = calloc (1, sizeof *desc);
+  struct log_commit *commit = calloc (1, sizeof *commit);
+  block_sector_t pos = log_start + 1;
+  size_t i, j;
+
+  if (desc == NULL || commit == NULL)
+    PANIC ("can't allocate journal buffers");
+
+  for (i = 0; i < cnt; i += DESC_SECTORS)
+    {
+      size_t n = cnt - i < DESC_SECTORS ? cnt - i : DESC_SECTORS;
+      desc->magic = DESC_MAGIC;
+      desc->seq = next_seq;
+      desc->cnt = n;
+      for (j = 0; j < n; j++)
+        desc->sectors[j] = images[i + j]->sector;
+      block_write (fs_device, pos++, desc);
+      for (j = 0; j < n; j++)
+        block_write (fs_device, pos++, images[i + j]->data);
+    }
+  commit->magic = COMMIT_MAGIC;
+  commit->seq = next_seq;
+  commit->cnt = cnt;
+  block_write (fs_device, pos, commit);
+
+  /* Committed.  Write in place, then let the log be reused. */
+  if (in_place)
+    {
+      for (i = 0; i < cnt; i++)
+        block_write (fs_device, images[i]->sector, images[i]->data);
+      next_seq++;
+      write_header ();
+    }
+
+  free (commit);
+  free (desc);
+}
+
+/* Commits the running transaction and, if IN_PLACE, writes it in
+   place, returning once that is done.  Otherwise, keeps
+   commit_lock, so that no later commit reuses the log. */
+static void
+do_commit (bool in_place)
+{
+  struct thread *cur = thread_current ();
+  struct image **images;
+  struct hash_iterator i;
+  struct txn *txn;
+  size_t cnt;
+
+  ASSERT (cur->journal_depth == 0);
+  lock_acquire (&commit_lock);
+
+  /* Wait for every operation in progress to finish. */
+  lock_acquire (&journal_lock);
+  draining = true;
+  commit_wanted = false;
+  while (active_cnt > 0)
+    cond_wait (&drained, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* Bring the free map up to date within the transaction.  This
+     thread counts as an operation meanwhile, so that the writes
+     do not wait for the very commit they belong to. */
+  cur->journal_depth++;
+  free_map_flush ();
+  cur->journal_depth--;
+
+  /* Start a new running transaction. */
+  lock_acquire (&journal_lock);
+  txn = running;
+  running = committing;
+  committing = txn;
+  running->id = txn->id + 1;
+  draining = false;
+  cond_broadcast (&may_begin, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* No one changes TXN any more, so it can be read without the
+     lock. */
+  cnt = hash_size (&txn->images);
+  if (cnt > 0)
+    {
+      images = malloc (cnt * sizeof *images);
+      if (images == NULL)
+        PANIC ("can't allocate journal buffers");
+      cnt = 0;
+      hash_first (&i, &txn->images);
+      while (hash_next (&i))
+        images[cnt++] = hash_entry (hash_cur (&i), struct image, elem);
+      ASSERT (cnt <= pass_max);
+      write_pass (images, cnt, in_place);
+      free (images);
+    }
+  if (!in_place)
+    return;
+
+  lock_acquire (&journal_lock);
+  committed_id = txn->id;
+  hash_clear (&txn->images, image_free);
+  lock_release (&journal_lock);
+
+  /* Sectors released in the transaction may now be reused. */
+  free_map_release_flushed ();
+
+  lock_release (&commit_lock);
+}
+
+/* Commits the running transaction and writes it in place,
+   returning once that is done. */
+void
+journal_commit (void)
+{
+  do_commit (true);
+}
+
+/* Commits the running transaction to the log but leaves it there,
+   as if power failed before it was written in place, so that the
+   next boot has to replay it.  The file system may not be used
+   afterward. */
+void
+journal_crash (void)
+{
+  do_commit (false);
+}
+
+/* Commit thread: commits every COMMIT_INTERVAL_MS, as asked by
+   the buffer cache's write-behind thread, or sooner once the
+   running transaction has no room for another operation. */
+static void
+commit_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      lock_acquire (&journal_lock);
+      while (!commit_wanted)
+        cond_wait (&commit_ready, &journal_lock);
+      lock_release (&journal_lock);
+      journal_commit ();
+    }
+}
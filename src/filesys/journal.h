@@ -0,0 +1,22 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+void journal_init (bool format);
+void journal_region (block_sector_t *start, size_t *cnt);
+
+void journal_begin (void);
+void journal_end (void);
+
+unsigned journal_log (block_sector_t, const void *data);
+bool journal_read (block_sector_t, void *data);
+bool journal_committed (unsigned txn);
+
+void journal_request_commit (void);
+void journal_commit (void);
+void journal_crash (void);
+
+#endif /* filesys/journal.h */
@@ -3,9 +3,11 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #endif
 
 /* Element type.
@@ -336,7 +338,8 @@ bitmap_file_size (const struct bitmap *b)
 }
 
 /* Reads B from FILE.  Returns true if successful, false
-   otherwise. */
+   otherwise.  Reads the inode directly, since the page cache
+   holds only user file data. */
 bool
 bitmap_read (struct bitmap *b, struct file *file) 
 {
@@ -344,19 +347,32 @@ bitmap_read (struct bitmap *b, struct file *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
-      success = file_read_at (file, b->bits, size, 0) == size;
+      success = (inode_read_at (file_get_inode (file), b->bits, size, 0)
+                 == size);
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
     }
   return success;
 }
 
 /* Writes B to FILE.  Return true if successful, false
-   otherwise. */
+   otherwise.  Like bitmap_read(), bypasses the page cache. */
 bool
 bitmap_write (const struct bitmap *b, struct file *file)
 {
   off_t size = byte_cnt (b->bit_cnt);
-  return file_write_at (file, b->bits, size, 0) == size;
+  return inode_write_at (file_get_inode (file), b->bits, size, 0) == size;
+}
+
+/* Copies bytes OFS through OFS + SIZE - 1 of B's file image into
+   DST, for writing out only the part of a bitmap that changed,
+   without B's owner holding its lock during the write. */
+void
+bitmap_copy_bytes (const struct bitmap *b, void *dst, size_t ofs,
+                   size_t size)
+{
+  ASSERT (ofs <= byte_cnt (b->bit_cnt));
+  ASSERT (size <= byte_cnt (b->bit_cnt) - ofs);
+  memcpy (dst, (const uint8_t *) b->bits + ofs, size);
 }
 #endif /* FILESYS */
 
@@ -0,0 +1,213 @@
+#include "radix.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/malloc.h"
+
+/* Interior or leaf node.  In a leaf, the slots hold the values;
+   elsewhere they point to the nodes one level down. */
+struct radix_node
+  {
+    void *slots[RADIX_SLOTS];
+    unsigned count;             /* Number of non-null slots. */
+  };
+
+/* Most levels a tree can need to cover every size_t key. */
+#define RADIX_MAX_HEIGHT ((sizeof (size_t) * 8 + RADIX_BITS - 1) / RADIX_BITS)
+
+/* Returns the largest key a tree of HEIGHT levels can hold. */
+static size_t
+max_key (unsigned height)
+{
+  if (height * RADIX_BITS >= sizeof (size_t) * 8)
+    return SIZE_MAX;
+  return ((size_t) 1 << (height * RADIX_BITS)) - 1;
+}
+
+/* Returns the slot of KEY in a node at LEVEL, counting leaves as
+   level 0. */
+static size_t
+slot_index (size_t key, unsigned level)
+{
+  return (key >> (level * RADIX_BITS)) & (RADIX_SLOTS - 1);
+}
+
+/* Returns a new, empty node, or a null pointer if memory is
+   exhausted. */
+static struct radix_node *
+new_node (void)
+{
+  return calloc (1, sizeof (struct radix_node));
+}
+
+/* Frees NODE, which sits at LEVEL on the way to KEY, if it is
+   empty, and then each ancestor in PATH that this leaves empty. */
+static void
+prune (struct radix_tree *tree, struct radix_node **path,
+       struct radix_node *node, unsigned level, size_t key)
+{
+  while (node->count == 0)
+    {
+      free (node);
+      if (level + 1 == tree->height)
+        {
+          tree->root = NULL;
+          tree->height = 0;
+          break;
+        }
+      node = path[level + 1];
+      node->slots[slot_index (key, level + 1)] = NULL;
+      node->count--;
+      level++;
+    }
+}
+
+/* Initializes TREE as an empty radix tree. */
+void
+radix_init (struct radix_tree *tree)
+{
+  tree->root = NULL;
+  tree->height = 0;
+}
+
+/* Returns the value stored under KEY in TREE, or a null pointer
+   if there is none. */
+void *
+radix_lookup (const struct radix_tree *tree, size_t key)
+{
+  struct radix_node *node = tree->root;
+  unsigned level;
+
+  if (node == NULL || key > max_key (tree->height))
+    return NULL;
+  for (level = tree->height - 1; level > 0; level--)
+    {
+      node = node->slots[slot_index (key, level)];
+      if (node == NULL)
+        return NULL;
+    }
+  return node->slots[slot_index (key, 0)];
+}
+
+/* Stores VALUE, which must not be null, under KEY in TREE, which
+   must not already have a value for KEY.  Returns false if
+   memory for a node could not be allocated, in which case TREE
+   holds the same values as before. */
+bool
+radix_insert (struct radix_tree *tree, size_t key, void *value)
+{
+  struct radix_node *path[RADIX_MAX_HEIGHT];
+  struct radix_node *node;
+  unsigned level;
+
+  ASSERT (value != NULL);
+
+  /* Add levels at the top until KEY fits. */
+  while (key > max_key (tree->height) || tree->root == NULL)
+    {
+      struct radix_node *root = new_node ();
+      if (root == NULL)
+        return false;
+      if (tree->root != NULL)
+        {
+          root->slots[0] = tree->root;
+          root->count = 1;
+          tree->height++;
+        }
+      else
+        {
+          tree->height = 1;
+          while (key > max_key (tree->height))
+            tree->height++;
+        }
+      tree->root = root;
+    }
+
+  node = tree->root;
+  for (level = tree->height - 1; level > 0; level--)
+    {
+      struct radix_node **child = (struct radix_node **)
+        &node->slots[slot_index (key, level)];
+      path[level] = node;
+      if (*child == NULL)
+        {
+          *child = new_node ();
+          if (*child == NULL)
+            {
+              prune (tree, path, node, level, key);
+              return false;
+            }
+          node->count++;
+        }
+      node = *child;
+    }
+
+  ASSERT (node->slots[slot_index (key, 0)] == NULL);
+  node->slots[slot_index (key, 0)] = value;
+  node->count++;
+  return true;
+}
+
+/* Removes the value stored under KEY from TREE and returns it,
+   or returns a null pointer if TREE has no value for KEY.  Nodes
+   left empty are freed. */
+void *
+radix_delete (struct radix_tree *tree, size_t key)
+{
+  struct radix_node *path[RADIX_MAX_HEIGHT];
+  struct radix_node *node = tree->root;
+  unsigned level;
+  void *value;
+
+  if (node == NULL || key > max_key (tree->height))
+    return NULL;
+  for (level = tree->height - 1; level > 0; level--)
+    {
+      path[level] = node;
+      node = node->slots[slot_index (key, level)];
+      if (node == NULL)
+        return NULL;
+    }
+
+  value = node->slots[slot_index (key, 0)];
+  if (value == NULL)
+    return NULL;
+  node->slots[slot_index (key, 0)] = NULL;
+  node->count--;
+  prune (tree, path, node, 0, key);
+  return value;
+}
+
+/* Returns the value in TREE with the smallest key and stores
+   that key into *KEY, or returns a null pointer if TREE is
+   empty. */
+void *
+radix_first (const struct radix_tree *tree, size_t *key)
+{
+  struct radix_node *node = tree->root;
+  unsigned level = tree->height;
+
+  *key = 0;
+  if (node == NULL)
+    return NULL;
+  for (;;)
+    {
+      size_t i;
+
+      /* Every node on the way down is non-empty, so this always
+         finds a slot. */
+      for (i = 0; node->slots[i] == NULL; i++)
+        ASSERT (i + 1 < RADIX_SLOTS);
+      level--;
+      *key |= i << (level * RADIX_BITS);
+      if (level == 0)
+        return node->slots[i];
+      node = node->slots[i];
+    }
+}
+
+/* Returns true if TREE holds no values. */
+bool
+radix_empty (const struct radix_tree *tree)
+{
+  return tree->root == NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef __LIB_KERNEL_RADIX_H
+#define __LIB_KERNEL_RADIX_H
+
+/* Radix tree.
+
+   Maps integer keys to non-null pointers.  Each node holds
+   RADIX_SLOTS slots and consumes RADIX_BITS bits of the key, so
+   a lookup takes one step per level no matter how many entries
+   the tree holds, and keys that are close together share nodes.
+   That suits dense, mostly small keys such as the page numbers
+   of a file.
+
+   The tree starts out with no levels and grows a level at the
+   top whenever a key too large for it is inserted.  Nodes are
+   freed as soon as they become empty. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RADIX_BITS 6
+#define RADIX_SLOTS (1 << RADIX_BITS)
+
+struct radix_node;
+
+/* Radix tree. */
+struct radix_tree
+  {
+    struct radix_node *root;    /* Top node, or null if empty. */
+    unsigned height;            /* Number of levels. */
+  };
+
+void radix_init (struct radix_tree *);
+void *radix_lookup (const struct radix_tree *, size_t key);
+bool radix_insert (struct radix_tree *, size_t key, void *value);
+void *radix_delete (struct radix_tree *, size_t key);
+void *radix_first (const struct radix_tree *, size_t *key);
+bool radix_empty (const struct radix_tree *);
+
+#endif /* lib/kernel/radix.h */
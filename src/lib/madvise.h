@@ -0,0 +1,14 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Advice for madvise(). */
+enum
+  {
+    MADV_NORMAL,                /* No special treatment. */
+    MADV_RANDOM,                /* Expect random access: no read-ahead. */
+    MADV_SEQUENTIAL,            /* Expect sequential access. */
+    MADV_WILLNEED,              /* Will be needed soon: prefetch. */
+    MADV_DONTNEED               /* Not needed anymore: drop. */
+  };
+
+#endif /* lib/madvise.h */
@@ -28,7 +28,14 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_FORK,                   /* Clone this process copy-on-write. */
+    SYS_VMSTAT,                 /* Obtain paging statistics. */
+    SYS_RSSLIMIT,               /* Change the resident set limit. */
+    SYS_MADVISE,                /* Give advice about memory use. */
+    SYS_FSYNC                   /* Write file system changes to disk. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -182,3 +182,33 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+void
+vmstat (struct vmstat *stats)
+{
+  syscall1 (SYS_VMSTAT, stats);
+}
+
+int
+rsslimit (int pages)
+{
+  return syscall1 (SYS_RSSLIMIT, pages);
+}
+
+int
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
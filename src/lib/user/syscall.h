@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <madvise.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,11 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+pid_t fork (void);
+void vmstat (struct vmstat *);
+int rsslimit (int pages);
+int madvise (void *addr, unsigned length, int advice);
+int fsync (int fd);
+
 #endif /* lib/user/syscall.h */
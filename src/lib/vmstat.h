@@ -0,0 +1,15 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+/* Paging statistics of a process, as returned by vmstat(). */
+struct vmstat
+  {
+    unsigned minor_faults;      /* Faults served without I/O. */
+    unsigned major_faults;      /* Faults that read a file or swap. */
+    unsigned swap_ins;          /* Pages read back from swap. */
+    unsigned swap_outs;         /* Pages written to swap. */
+    unsigned evictions;         /* Pages taken away by eviction. */
+    unsigned resident;          /* Pages currently held in frames. */
+  };
+
+#endif /* lib/vmstat.h */
@@ -0,0 +1,26 @@
+/* Writes a 40,000-byte file 100 bytes at a time and reads it
+   back, through a buffer cache of only 8 sectors, set by
+   -fscache.  Dirty sectors have to be written behind as they are
+   evicted, and reads run ahead of a cache too small to hold the
+   file. */
+
+#include "tests/filesys/seq-test.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 40000
+
+static char buf[TEST_SIZE];
+
+static size_t
+return_block_size (void) 
+{
+  return 100;
+}
+
+void
+test_main (void) 
+{
+  seq_test ("testme",
+            buf, sizeof buf, 0,
+            return_block_size, NULL);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-small) begin
+(cache-small) create "testme"
+(cache-small) open "testme"
+(cache-small) writing "testme"
+(cache-small) close "testme"
+(cache-small) open "testme" for verification
+(cache-small) verified contents of "testme"
+(cache-small) close "testme"
+(cache-small) end
+EOF
+pass;
@@ -0,0 +1,88 @@
+/* Child process for syn-inode.
+   Children numbered below WRITER_CNT fill every block of their
+   own file with the round number, ROUND_CNT times over.  The
+   others read every block of each file as many times and check
+   that all the bytes of a block are the same, since each block
+   is written with a single write(). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-inode.h"
+#include "tests/lib.h"
+
+static char buf[BLOCK_SIZE];
+
+/* Fills every block of FILE_NAME, opened as FD, with each round
+   number in turn. */
+static void
+write_rounds (int fd, const char *file_name)
+{
+  int round, block;
+
+  for (round = 1; round <= ROUND_CNT; round++)
+    {
+      memset (buf, round, sizeof buf);
+      for (block = 0; block < BLOCK_CNT; block++)
+        {
+          seek (fd, block * BLOCK_SIZE);
+          if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+            fail ("write of block %d of \"%s\" failed", block, file_name);
+        }
+    }
+}
+
+/* Reads every block of FILE_NAME, opened as FD, and checks that
+   each was read whole and in one piece. */
+static void
+read_blocks (int fd, const char *file_name)
+{
+  int block;
+  size_t i;
+
+  for (block = 0; block < BLOCK_CNT; block++)
+    {
+      seek (fd, block * BLOCK_SIZE);
+      if (read (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("read of block %d of \"%s\" failed", block, file_name);
+      for (i = 1; i < BLOCK_SIZE; i++)
+        if (buf[i] != buf[0] || buf[0] > ROUND_CNT)
+          fail ("block %d of \"%s\" read half written: "
+                "byte %zu is %d, byte 0 is %d",
+                block, file_name, i, buf[i], buf[0]);
+    }
+}
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_names[WRITER_CNT][16];
+  int fds[WRITER_CNT];
+  int child_idx;
+  int i, round;
+
+  test_name = "child-syn-inode";
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  for (i = 0; i < WRITER_CNT; i++)
+    {
+      snprintf (file_names[i], sizeof file_names[i], "file%d", i);
+      CHECK ((fds[i] = open (file_names[i])) > 1,
+             "open \"%s\"", file_names[i]);
+    }
+
+  if (child_idx < WRITER_CNT)
+    write_rounds (fds[child_idx], file_names[child_idx]);
+  else
+    for (round = 0; round < ROUND_CNT; round++)
+      for (i = 0; i < WRITER_CNT; i++)
+        read_blocks (fds[i], file_names[i]);
+
+  for (i = 0; i < WRITER_CNT; i++)
+    close (fds[i]);
+  return child_idx;
+}
@@ -0,0 +1,66 @@
+/* Creates 2,000 files in one directory and looks each of them up
+   again, then removes every other one and checks that readdir()
+   lists exactly the files that are left. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 2000
+
+static bool seen[FILE_CNT];
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  char file_name[32];
+  size_t i, cnt;
+  int fd;
+
+  CHECK (mkdir ("big"), "mkdir \"big\"");
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "big/f%zu", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+    }
+
+  msg ("open each file");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "big/f%zu", i);
+      if ((fd = open (file_name)) < 2)
+        fail ("open \"%s\" failed", file_name);
+      close (fd);
+    }
+
+  msg ("remove every other file");
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (file_name, sizeof file_name, "big/f%zu", i);
+      if (!remove (file_name))
+        fail ("remove \"%s\" failed", file_name);
+    }
+
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  msg ("read directory");
+  cnt = 0;
+  while (readdir (fd, name))
+    {
+      size_t idx = atoi (name + 1);
+      if (name[0] != 'f' || idx >= FILE_CNT || idx % 2 != 0 || seen[idx])
+        fail ("readdir returned unexpected entry \"%s\"", name);
+      seen[idx] = true;
+      cnt++;
+    }
+  if (cnt != FILE_CNT / 2)
+    fail ("readdir returned %zu entries, expected %d", cnt, FILE_CNT / 2);
+  msg ("close \"big\"");
+  close (fd);
+}
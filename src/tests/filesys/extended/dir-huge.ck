@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-huge) begin
+(dir-huge) mkdir "big"
+(dir-huge) create 2000 files
+(dir-huge) open each file
+(dir-huge) remove every other file
+(dir-huge) open "big"
+(dir-huge) read directory
+(dir-huge) close "big"
+(dir-huge) end
+EOF
+pass;
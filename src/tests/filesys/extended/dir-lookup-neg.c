@@ -0,0 +1,41 @@
+/* Looks up names that do not exist, then creates them, and checks
+   that the lookups that failed before do not keep failing, and
+   that names stop resolving once they are removed, however the
+   path to them is spelled. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (open ("a/b/c") == -1, "open \"a/b/c\" (must return -1)");
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/b"), "mkdir \"a/b\"");
+  CHECK (open ("a/b/c") == -1, "open \"a/b/c\" again (must return -1)");
+  CHECK (create ("a/b/c", 0), "create \"a/b/c\"");
+  CHECK ((fd = open ("a/b/c")) > 1, "open \"a/b/c\"");
+  close (fd);
+
+  CHECK (chdir ("a"), "chdir \"a\"");
+  CHECK ((fd = open ("b/c")) > 1, "open \"b/c\"");
+  close (fd);
+  CHECK ((fd = open ("../a/b/c")) > 1, "open \"../a/b/c\"");
+  close (fd);
+
+  CHECK (remove ("b/c"), "remove \"b/c\"");
+  CHECK (open ("b/c") == -1, "open \"b/c\" (must return -1)");
+  CHECK (open ("/a/b/c") == -1, "open \"/a/b/c\" (must return -1)");
+
+  CHECK (remove ("b"), "remove \"b\"");
+  CHECK (open ("b") == -1, "open \"b\" (must return -1)");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK (open ("b/c") == -1, "open \"b/c\" in new \"b\" (must return -1)");
+  CHECK (create ("/a/b/c", 512), "create \"/a/b/c\"");
+  CHECK ((fd = open ("b/c")) > 1, "open \"b/c\"");
+  CHECK (filesize (fd) == 512, "filesize \"b/c\" is 512");
+  close (fd);
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-lookup-neg) begin
+(dir-lookup-neg) open "a/b/c" (must return -1)
+(dir-lookup-neg) mkdir "a"
+(dir-lookup-neg) mkdir "a/b"
+(dir-lookup-neg) open "a/b/c" again (must return -1)
+(dir-lookup-neg) create "a/b/c"
+(dir-lookup-neg) open "a/b/c"
+(dir-lookup-neg) chdir "a"
+(dir-lookup-neg) open "b/c"
+(dir-lookup-neg) open "../a/b/c"
+(dir-lookup-neg) remove "b/c"
+(dir-lookup-neg) open "b/c" (must return -1)
+(dir-lookup-neg) open "/a/b/c" (must return -1)
+(dir-lookup-neg) remove "b"
+(dir-lookup-neg) open "b" (must return -1)
+(dir-lookup-neg) mkdir "b"
+(dir-lookup-neg) open "b/c" in new "b" (must return -1)
+(dir-lookup-neg) create "/a/b/c"
+(dir-lookup-neg) open "b/c"
+(dir-lookup-neg) filesize "b/c" is 512
+(dir-lookup-neg) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($buf) = random_bytes (100);
+my ($fs) = {"file0" => ['']};
+$fs->{"file$_"} = [$buf] foreach 1...39;
+check_archive ($fs);
+pass;
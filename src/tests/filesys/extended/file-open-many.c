@@ -0,0 +1,80 @@
+/* Opens each of 40 files three times and checks that the opens of
+   a file share one inode, and that different files do not.
+   Writes through one descriptor of each file and reads the data
+   back through another.  Finally, removes a file that is still
+   open and checks that a new file of the same name gets an inode
+   of its own. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+#define OPEN_CNT 3
+
+static char buf[100];
+static int fds[FILE_CNT][OPEN_CNT];
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  char data[sizeof buf];
+  size_t i, j;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  msg ("create and open %d files %d times each", FILE_CNT, OPEN_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+      for (j = 0; j < OPEN_CNT; j++)
+        if ((fds[i][j] = open (file_name)) < 2)
+          fail ("open \"%s\" failed", file_name);
+    }
+
+  msg ("check inode numbers");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      for (j = 1; j < OPEN_CNT; j++)
+        if (inumber (fds[i][j]) != inumber (fds[i][0]))
+          fail ("opens of file%zu have different inode numbers", i);
+      for (j = 0; j < i; j++)
+        if (inumber (fds[i][0]) == inumber (fds[j][0]))
+          fail ("file%zu and file%zu have the same inode number", i, j);
+    }
+
+  msg ("write through one descriptor, read through another");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      if (write (fds[i][0], buf, sizeof buf) != sizeof buf)
+        fail ("write to file%zu failed", i);
+      if (filesize (fds[i][OPEN_CNT - 1]) != sizeof buf)
+        fail ("file%zu has wrong size through another descriptor", i);
+      if (read (fds[i][OPEN_CNT - 1], data, sizeof data) != sizeof data)
+        fail ("read from file%zu failed", i);
+      compare_bytes (data, buf, sizeof data, 0, "file");
+    }
+
+  CHECK (remove ("file0"), "remove \"file0\"");
+  CHECK (create ("file0", 0), "create \"file0\"");
+  CHECK ((fd = open ("file0")) > 1, "open \"file0\"");
+  CHECK (inumber (fd) != inumber (fds[0][0]),
+         "new \"file0\" has its own inode");
+  if (read (fds[0][1], data, sizeof data) != sizeof data)
+    fail ("read from removed file0 failed");
+  compare_bytes (data, buf, sizeof data, 0, "removed file0");
+  msg ("removed \"file0\" still readable");
+  close (fd);
+
+  msg ("close all files");
+  for (i = 0; i < FILE_CNT; i++)
+    for (j = 0; j < OPEN_CNT; j++)
+      close (fds[i][j]);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(file-open-many) begin
+(file-open-many) create and open 40 files 3 times each
+(file-open-many) check inode numbers
+(file-open-many) write through one descriptor, read through another
+(file-open-many) remove "file0"
+(file-open-many) create "file0"
+(file-open-many) open "file0"
+(file-open-many) new "file0" has its own inode
+(file-open-many) removed "file0" still readable
+(file-open-many) close all files
+(file-open-many) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($small) = random_bytes (8192);
+my ($fs) = {"big" => [random_bytes (200000)]};
+$fs->{"small$_"} = [$small] foreach grep ($_ % 2 == 0, 0...15);
+check_archive ($fs);
+pass;
@@ -0,0 +1,65 @@
+/* Creates 16 files of 8 kB, removes every other one, and then
+   grows a 200,000-byte file that does not fit in any one of the
+   holes left behind.  Checks that the new file and the remaining
+   small files read back intact. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/seq-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SMALL_CNT 16
+#define SMALL_SIZE 8192
+#define BIG_SIZE 200000
+
+static char small[SMALL_SIZE];
+static char big[BIG_SIZE];
+
+static size_t
+return_block_size (void) 
+{
+  return 4096;
+}
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  size_t i;
+  int fd;
+
+  random_init (0);
+  random_bytes (small, sizeof small);
+
+  msg ("create %d files", SMALL_CNT);
+  for (i = 0; i < SMALL_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "small%zu", i);
+      if (!create (file_name, 0) || (fd = open (file_name)) < 2)
+        fail ("create \"%s\" failed", file_name);
+      if (write (fd, small, sizeof small) != sizeof small)
+        fail ("write \"%s\" failed", file_name);
+      close (fd);
+    }
+
+  msg ("remove every other file");
+  for (i = 1; i < SMALL_CNT; i += 2)
+    {
+      snprintf (file_name, sizeof file_name, "small%zu", i);
+      if (!remove (file_name))
+        fail ("remove \"%s\" failed", file_name);
+    }
+
+  seq_test ("big", big, sizeof big, 0, return_block_size, NULL);
+
+  quiet = true;
+  for (i = 0; i < SMALL_CNT; i += 2)
+    {
+      snprintf (file_name, sizeof file_name, "small%zu", i);
+      check_file (file_name, small, sizeof small);
+    }
+  quiet = false;
+  msg ("verified remaining files");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fragment) begin
+(grow-fragment) create 16 files
+(grow-fragment) remove every other file
+(grow-fragment) create "big"
+(grow-fragment) open "big"
+(grow-fragment) writing "big"
+(grow-fragment) close "big"
+(grow-fragment) open "big" for verification
+(grow-fragment) verified contents of "big"
+(grow-fragment) close "big"
+(grow-fragment) verified remaining files
+(grow-fragment) end
+EOF
+pass;
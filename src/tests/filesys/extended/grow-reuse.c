@@ -0,0 +1,62 @@
+/* Creates, verifies and removes a 300,000-byte file 8 times, more
+   than the disk could hold at once, syncing after each removal so
+   that the freed sectors can be reused.  Then creates the file one
+   last time and keeps it. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 300000
+#define ROUND_CNT 8
+
+static char buf[FILE_SIZE];
+
+/* Creates FILE_NAME holding BUF and verifies it. */
+static void
+write_file (const char *file_name) 
+{
+  size_t ofs;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += 4096)
+    {
+      size_t block_size = FILE_SIZE - ofs < 4096 ? FILE_SIZE - ofs : 4096;
+      if (write (fd, buf + ofs, block_size) != (int) block_size)
+        fail ("write %zu bytes at offset %zu in \"%s\" failed",
+              block_size, ofs, file_name);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, FILE_SIZE);
+}
+
+void
+test_main (void) 
+{
+  int sync_fd;
+  size_t i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("sync", 0), "create \"sync\"");
+  CHECK ((sync_fd = open ("sync")) > 1, "open \"sync\"");
+
+  msg ("create and remove \"temp\" %d times", ROUND_CNT);
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      quiet = true;
+      write_file ("temp");
+      CHECK (remove ("temp"), "remove \"temp\"");
+      CHECK (fsync (sync_fd) == 0, "fsync \"sync\"");
+      quiet = false;
+    }
+
+  write_file ("last");
+  msg ("close \"sync\"");
+  close (sync_fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-reuse) begin
+(grow-reuse) create "sync"
+(grow-reuse) open "sync"
+(grow-reuse) create and remove "temp" 8 times
+(grow-reuse) create "last"
+(grow-reuse) open "last"
+(grow-reuse) close "last"
+(grow-reuse) open "last" for verification
+(grow-reuse) verified contents of "last"
+(grow-reuse) close "last"
+(grow-reuse) close "sync"
+(grow-reuse) end
+EOF
+pass;
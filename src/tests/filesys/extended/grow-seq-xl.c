@@ -0,0 +1,5 @@
+/* Grows a file from 0 bytes to 600,000 bytes, 1,234 bytes at a
+   time, far enough to need doubly indirect blocks. */
+
+#define TEST_SIZE 600000
+#include "tests/filesys/extended/grow-seq.inc"
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"sparse" => ["\0" x 100000, random_bytes (100),
+                             "\0" x 99900]});
+pass;
@@ -0,0 +1,88 @@
+/* Creates a file of 8 MB, which is larger than the whole file
+   system disk, and so succeeds only if the initial length is not
+   allocated up front.  Writes to a few places in it and checks
+   that the rest reads back as zeros.  Then removes it and leaves
+   behind a smaller sparse file for the persistence check. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HUGE_SIZE (8 * 1024 * 1024)
+#define SMALL_SIZE 200000
+
+static char buf[512];
+static char data[100];
+
+/* Reads sizeof BUF bytes from FD at offset OFS and checks that
+   they are all zero. */
+static void
+check_zeros (int fd, const char *file_name, unsigned ofs)
+{
+  size_t i;
+
+  seek (fd, ofs);
+  if (read (fd, buf, sizeof buf) != (int) sizeof buf)
+    fail ("read %zu bytes at offset %u in \"%s\" failed",
+          sizeof buf, ofs, file_name);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %u in \"%s\" is %d, not zero",
+            ofs + i, file_name, buf[i]);
+}
+
+/* Writes DATA to FD at offset OFS and reads it back. */
+static void
+write_and_check (int fd, const char *file_name, unsigned ofs)
+{
+  seek (fd, ofs);
+  if (write (fd, data, sizeof data) != (int) sizeof data)
+    fail ("write %zu bytes at offset %u in \"%s\" failed",
+          sizeof data, ofs, file_name);
+  seek (fd, ofs);
+  if (read (fd, buf, sizeof data) != (int) sizeof data)
+    fail ("read %zu bytes at offset %u in \"%s\" failed",
+          sizeof data, ofs, file_name);
+  if (memcmp (buf, data, sizeof data))
+    fail ("data at offset %u in \"%s\" differs from what was written",
+          ofs, file_name);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (data, sizeof data);
+
+  CHECK (create ("huge", HUGE_SIZE), "create \"huge\"");
+  CHECK ((fd = open ("huge")) > 1, "open \"huge\"");
+  CHECK (filesize (fd) == HUGE_SIZE, "filesize \"huge\" is %d", HUGE_SIZE);
+
+  msg ("check that unwritten parts of \"huge\" read as zeros");
+  check_zeros (fd, "huge", 0);
+  check_zeros (fd, "huge", HUGE_SIZE / 2);
+  check_zeros (fd, "huge", HUGE_SIZE - sizeof buf);
+
+  msg ("write to the middle and end of \"huge\"");
+  write_and_check (fd, "huge", HUGE_SIZE / 2 + 1000);
+  write_and_check (fd, "huge", HUGE_SIZE - sizeof data);
+  CHECK (filesize (fd) == HUGE_SIZE, "filesize \"huge\" is still %d",
+         HUGE_SIZE);
+  check_zeros (fd, "huge", HUGE_SIZE / 4);
+  check_zeros (fd, "huge", HUGE_SIZE / 2 - sizeof buf);
+
+  msg ("close \"huge\"");
+  close (fd);
+  CHECK (remove ("huge"), "remove \"huge\"");
+
+  CHECK (create ("sparse", SMALL_SIZE), "create \"sparse\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  msg ("write to the middle of \"sparse\"");
+  write_and_check (fd, "sparse", SMALL_SIZE / 2);
+  msg ("close \"sparse\"");
+  close (fd);
+}
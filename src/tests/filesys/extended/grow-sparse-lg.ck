@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-lg) begin
+(grow-sparse-lg) create "huge"
+(grow-sparse-lg) open "huge"
+(grow-sparse-lg) filesize "huge" is 8388608
+(grow-sparse-lg) check that unwritten parts of "huge" read as zeros
+(grow-sparse-lg) write to the middle and end of "huge"
+(grow-sparse-lg) filesize "huge" is still 8388608
+(grow-sparse-lg) close "huge"
+(grow-sparse-lg) remove "huge"
+(grow-sparse-lg) create "sparse"
+(grow-sparse-lg) open "sparse"
+(grow-sparse-lg) write to the middle of "sparse"
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) end
+EOF
+pass;
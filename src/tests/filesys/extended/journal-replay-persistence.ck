@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"data" => [random_bytes (5000)],
+		"d" => {"e" => [''], "f" => ["\0" x 1000]}});
+
+our ($test);
+fail "file system journal was not replayed\n"
+  if !grep (/^Replaying file system journal\.\.\.done\.$/,
+	    read_text_file ("$test.output"));
+pass;
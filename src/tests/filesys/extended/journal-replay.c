@@ -0,0 +1,34 @@
+/* Writes a file and syncs it, then creates and removes more files
+   and directories without syncing.  Runs with -fscrash, which
+   powers off with the last journal transaction committed to the
+   log but not written in place, so the later changes survive the
+   reboot only if the journal is replayed. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5000];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"data\"");
+  CHECK (fsync (fd) == 0, "fsync \"data\"");
+  msg ("close \"data\"");
+  close (fd);
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (create ("d/e", 0), "create \"d/e\"");
+  CHECK (create ("d/f", 1000), "create \"d/f\"");
+  CHECK (create ("tmp", 0), "create \"tmp\"");
+  CHECK (remove ("tmp"), "remove \"tmp\"");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(journal-replay) begin
+(journal-replay) create "data"
+(journal-replay) open "data"
+(journal-replay) write "data"
+(journal-replay) fsync "data"
+(journal-replay) close "data"
+(journal-replay) mkdir "d"
+(journal-replay) create "d/e"
+(journal-replay) create "d/f"
+(journal-replay) create "tmp"
+(journal-replay) remove "tmp"
+(journal-replay) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"child-syn-inode" => "tests/filesys/extended/child-syn-inode",
+		"file0" => [chr (30) x 16384],
+		"file1" => [chr (30) x 16384]});
+pass;
@@ -0,0 +1,36 @@
+/* Starts two processes that each rewrite a file of their own, a
+   block at a time, while two more processes read both files and
+   check that no read sees a block half written. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-inode.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[WRITER_CNT + READER_CNT];
+  char file_name[16];
+  int i;
+
+  for (i = 0; i < WRITER_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+    }
+
+  exec_children ("child-syn-inode", children, WRITER_CNT + READER_CNT);
+  wait_children (children, WRITER_CNT + READER_CNT);
+
+  memset (buf, ROUND_CNT, sizeof buf);
+  for (i = 0; i < WRITER_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      check_file (file_name, buf, sizeof buf);
+    }
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-inode) begin
+(syn-inode) create "file0"
+(syn-inode) create "file1"
+(syn-inode) exec child 1 of 4: "child-syn-inode 0"
+(syn-inode) exec child 2 of 4: "child-syn-inode 1"
+(syn-inode) exec child 3 of 4: "child-syn-inode 2"
+(syn-inode) exec child 4 of 4: "child-syn-inode 3"
+(syn-inode) wait for child 1 of 4 returned 0 (expected 0)
+(syn-inode) wait for child 2 of 4 returned 1 (expected 1)
+(syn-inode) wait for child 3 of 4 returned 2 (expected 2)
+(syn-inode) wait for child 4 of 4 returned 3 (expected 3)
+(syn-inode) open "file0" for verification
+(syn-inode) verified contents of "file0"
+(syn-inode) close "file0"
+(syn-inode) open "file1" for verification
+(syn-inode) verified contents of "file1"
+(syn-inode) close "file1"
+(syn-inode) end
+EOF
+pass;
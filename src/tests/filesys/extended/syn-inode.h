@@ -0,0 +1,11 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_INODE_H
+#define TESTS_FILESYS_EXTENDED_SYN_INODE_H
+
+#define BLOCK_SIZE 4096
+#define BLOCK_CNT 4
+#define FILE_SIZE (BLOCK_SIZE * BLOCK_CNT)
+#define ROUND_CNT 30
+#define WRITER_CNT 2
+#define READER_CNT 2
+
+#endif /* tests/filesys/extended/syn-inode.h */
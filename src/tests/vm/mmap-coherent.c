@@ -0,0 +1,40 @@
+/* Checks that a mapping and the read and write system calls see
+   each other's changes to a file while it stays mapped. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  size_t size = strlen (sample);
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", size), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  /* Bring the page in, then write the file behind it. */
+  if (*(char *) ACTUAL != 0)
+    fail ("new file not zeroed");
+  CHECK (write (handle, sample, size) == (int) size, "write \"sample.txt\"");
+  CHECK (!memcmp (ACTUAL, sample, size), "compare mapping against written data");
+
+  /* Change the mapping and read the change back. */
+  memset (ACTUAL, 'x', 16);
+  seek (handle, 0);
+  CHECK (read (handle, buf, size) == (int) size, "read \"sample.txt\"");
+  CHECK (!memcmp (buf, "xxxxxxxxxxxxxxxx", 16)
+         && !memcmp (buf + 16, sample + 16, size - 16),
+         "compare read data against mapping");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,42 @@
+/* Forks a child that modifies a large buffer shared with its
+   parent copy-on-write, and verifies that each process sees only
+   its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (128 * 1024)
+
+static char buf[SIZE];
+
+static void
+check (char value)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != value)
+      fail ("byte %zu is %d, should be %d", i, buf[i], value);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  memset (buf, 0x5a, sizeof buf);
+  child = fork ();
+  if (child == 0)
+    {
+      check (0x5a);
+      memset (buf, 0x33, sizeof buf);
+      check (0x33);
+      exit (81);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 81, "wait for child");
+  msg ("parent buffer unchanged");
+  check (0x5a);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork-cow) begin
+(page-fork-cow) fork
+(page-fork-cow) wait for child
+(page-fork-cow) parent buffer unchanged
+(page-fork-cow) end
+EOF
+pass;
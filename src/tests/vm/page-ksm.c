@@ -0,0 +1,57 @@
+/* Fills 32 pages with the same bytes and waits on the disk long
+   enough for the same-page merging scanner, enabled by -ksm, to
+   merge them.  Then writes to one page and verifies that the
+   write splits it off without changing the others. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 32
+
+/* Times to write and sync the file below.  Each waits on the
+   disk, giving the scanner, which only runs when nothing else
+   can, a chance to run. */
+#define SYNC_CNT 200
+
+static char buf[PAGE_CNT][PAGE_SIZE];
+
+/* Verifies that page I holds VALUE throughout. */
+static void
+check_page (size_t i, char value)
+{
+  size_t j;
+
+  for (j = 0; j < PAGE_SIZE; j++)
+    if (buf[i][j] != value)
+      fail ("byte %zu of page %zu is %d, should be %d",
+            j, i, buf[i][j], value);
+}
+
+void
+test_main (void)
+{
+  char block[512];
+  int fd;
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    memset (buf[i], 0x5a, PAGE_SIZE);
+
+  msg ("wait for merging");
+  memset (block, 0, sizeof block);
+  CHECK (create ("idle", 0), "create \"idle\"");
+  CHECK ((fd = open ("idle")) > 1, "open \"idle\"");
+  for (i = 0; i < SYNC_CNT; i++)
+    if (write (fd, block, sizeof block) != sizeof block || fsync (fd) != 0)
+      fail ("write and sync %zu failed", i);
+  close (fd);
+
+  msg ("write one page");
+  memset (buf[PAGE_CNT / 2], 0x33, PAGE_SIZE);
+  for (i = 0; i < PAGE_CNT; i++)
+    check_page (i, i == PAGE_CNT / 2 ? 0x33 : 0x5a);
+  msg ("other pages unchanged");
+}
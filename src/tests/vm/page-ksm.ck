@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-ksm) begin
+(page-ksm) wait for merging
+(page-ksm) create "idle"
+(page-ksm) open "idle"
+(page-ksm) write one page
+(page-ksm) other pages unchanged
+(page-ksm) end
+EOF
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+my ($merged) = map (/^KSM: \d+ frames scanned, (\d+) merged/, @output);
+fail "KSM statistics missing from output\n" if !defined $merged;
+fail "no pages were merged\n" if $merged == 0;
+pass;
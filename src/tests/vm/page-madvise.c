@@ -0,0 +1,60 @@
+/* Drops anonymous pages with MADV_DONTNEED and checks that they
+   come back zeroed, then prefetches a mapped file with
+   MADV_WILLNEED and checks that reading it takes no more major
+   faults. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 4
+
+static char raw[(PAGE_CNT + 1) * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  char *buf = (char *) (((uintptr_t) raw + PAGE_SIZE - 1)
+                        & ~(uintptr_t) (PAGE_SIZE - 1));
+  char *actual = (char *) 0x10000000;
+  struct vmstat before, after;
+  int handle;
+  size_t i;
+
+  memset (buf, 0x5a, PAGE_CNT * PAGE_SIZE);
+  vmstat (&before);
+  CHECK (madvise (buf, PAGE_CNT * PAGE_SIZE, MADV_DONTNEED) == 0,
+         "madvise MADV_DONTNEED");
+  vmstat (&after);
+  if (after.resident + PAGE_CNT > before.resident)
+    fail ("%u pages resident before, %u after", before.resident,
+          after.resident);
+  for (i = 0; i < PAGE_CNT * PAGE_SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d after MADV_DONTNEED", i, buf[i]);
+  msg ("dropped pages read back as zeros");
+
+  CHECK (madvise (buf + 1, PAGE_SIZE, MADV_NORMAL) == -1,
+         "madvise misaligned address (must return -1)");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, actual) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (madvise (actual, PAGE_SIZE, MADV_WILLNEED) == 0,
+         "madvise MADV_WILLNEED");
+
+  /* Fault in the code and data used below before counting. */
+  if (memcmp (sample, sample, strlen (sample)))
+    fail ("sample differs from itself");
+  vmstat (&before);
+  if (memcmp (actual, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+  vmstat (&after);
+  if (after.major_faults != before.major_faults)
+    fail ("%u major faults reading prefetched page",
+          after.major_faults - before.major_faults);
+  msg ("prefetched page read without major faults");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-madvise) begin
+(page-madvise) madvise MADV_DONTNEED
+(page-madvise) dropped pages read back as zeros
+(page-madvise) madvise misaligned address (must return -1)
+(page-madvise) open "sample.txt"
+(page-madvise) mmap "sample.txt"
+(page-madvise) madvise MADV_WILLNEED
+(page-madvise) prefetched page read without major faults
+(page-madvise) end
+EOF
+pass;
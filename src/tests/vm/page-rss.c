@@ -0,0 +1,51 @@
+/* Runs with a resident set limit of 32 pages, set by -rss, and
+   writes 512 kB of memory, so that the process has to page out
+   its own frames to stay within the limit.  Then lifts the limit
+   with rsslimit() and verifies that the pages can all be
+   resident again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LIMIT 32
+#define SIZE (512 * 1024)
+
+static char buf[SIZE];
+
+/* Fills BUF with VALUE and checks it, returning the number of
+   resident pages afterward. */
+static unsigned
+fill_and_check (char value)
+{
+  struct vmstat stats;
+  size_t i;
+
+  memset (buf, value, sizeof buf);
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != value)
+      fail ("byte %zu is %d, should be %d", i, buf[i], value);
+  vmstat (&stats);
+  return stats.resident;
+}
+
+void
+test_main (void)
+{
+  struct vmstat stats;
+  unsigned resident;
+
+  CHECK (rsslimit (-1) == LIMIT, "limit set by -rss");
+  resident = fill_and_check (0x5a);
+  if (resident > LIMIT)
+    fail ("%u pages resident, limit is %d", resident, LIMIT);
+  vmstat (&stats);
+  CHECK (stats.swap_outs > 0, "own pages were swapped out");
+
+  CHECK (rsslimit (0) == LIMIT, "lift limit");
+  resident = fill_and_check (0x33);
+  if (resident <= LIMIT)
+    fail ("only %u pages resident without a limit", resident);
+  msg ("pages resident again");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rss) begin
+(page-rss) limit set by -rss
+(page-rss) own pages were swapped out
+(page-rss) lift limit
+(page-rss) pages resident again
+(page-rss) end
+EOF
+pass;
@@ -0,0 +1,36 @@
+/* Encrypts, then decrypts, 1 MB of memory in a process limited
+   to much less memory than that, swapping to two devices of the
+   same priority, and verifies that the values are as they should
+   be. */
+
+#include <string.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  struct arc4 arc4;
+  size_t i;
+
+  msg ("initialize");
+  memset (buf, 0x5a, sizeof buf);
+
+  msg ("encrypt");
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, buf, SIZE);
+
+  msg ("decrypt");
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, buf, SIZE);
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0x5a)
+      fail ("byte %zu != 0x5a", i);
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-stripe) begin
+(page-stripe) initialize
+(page-stripe) encrypt
+(page-stripe) decrypt
+(page-stripe) read pass
+(page-stripe) end
+EOF
+
+# The test swaps to the swap partition, hda4, and to the scratch
+# partition, hda3, which is unused once the test program has been
+# extracted from it.  Extraction itself writes 2 sectors.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+for my $bdev ('hda4', 'hda3') {
+    fail "$bdev not used for swap\n"
+      if !grep (/^swap: using $bdev, priority 1$/, @output);
+}
+my ($swap_writes) = map (/^hda4 \(swap\): \d+ reads, (\d+) writes$/, @output);
+my ($scratch_writes)
+  = map (/^hda3 \(scratch\): \d+ reads, (\d+) writes$/, @output);
+fail "no swap writes to hda4\n" if !$swap_writes;
+fail "no swap writes to hda3\n"
+  if !defined $scratch_writes || $scratch_writes <= 2;
+pass;
@@ -0,0 +1,66 @@
+/* Fills 512 kB of memory, alternating pages that compress well
+   with pages of random bytes, in a process limited to much less
+   memory than that, so that most pages go through the compressed
+   swap cache, and verifies that every page comes back intact. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 128
+
+static char buf[PAGE_CNT][PAGE_SIZE];
+
+/* Fills or, if FILL is false, verifies page I. */
+static void
+process_page (size_t i, bool fill)
+{
+  struct arc4 arc4;
+  size_t j;
+
+  if (i % 2 == 0)
+    {
+      char value = 'a' + i % 26;
+      if (fill)
+        memset (buf[i], value, PAGE_SIZE);
+      else
+        for (j = 0; j < PAGE_SIZE; j++)
+          if (buf[i][j] != value)
+            fail ("byte %zu of page %zu is %d, should be %d",
+                  j, i, buf[i][j], value);
+    }
+  else
+    {
+      /* Encrypting a zeroed page yields random bytes, and
+         encrypting them again with the same key yields zeros. */
+      arc4_init (&arc4, &i, sizeof i);
+      arc4_crypt (&arc4, buf[i], PAGE_SIZE);
+      if (!fill)
+        for (j = 0; j < PAGE_SIZE; j++)
+          if (buf[i][j] != 0)
+            fail ("byte %zu of page %zu is %d after decryption",
+                  j, i, buf[i][j]);
+    }
+}
+
+void
+test_main (void)
+{
+  struct vmstat stats;
+  size_t i;
+
+  msg ("fill");
+  for (i = 0; i < PAGE_CNT; i++)
+    process_page (i, true);
+
+  msg ("verify");
+  for (i = 0; i < PAGE_CNT; i++)
+    process_page (i, false);
+
+  vmstat (&stats);
+  CHECK (stats.swap_outs > 0, "pages were swapped out");
+  CHECK (stats.swap_ins > 0, "pages were swapped in");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-zswap) begin
+(page-zswap) fill
+(page-zswap) verify
+(page-zswap) pages were swapped out
+(page-zswap) pages were swapped in
+(page-zswap) end
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Grows the stack into the page just below the executable's
+   first page, with the stack region stretched over all of user
+   memory, and checks that only that one page is mapped.  Stack
+   pages are prefaulted only below an existing stack page, not
+   below code or data.
+   This must succeed. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Start of the executable's first segment. */
+#define CODE_START 0x08048000
+
+void
+test_main (void)
+{
+  struct vmstat before, after;
+  uint32_t saved_esp;
+
+  /* Once to fault in vmstat()'s code and data. */
+  vmstat (&before);
+  vmstat (&before);
+
+  /* Push a word with the stack pointer at CODE_START, faulting in
+     the page below it as stack. */
+  asm volatile ("movl %%esp, %0\n\t"
+                "movl %1, %%esp\n\t"
+                "pushl $0\n\t"
+                "movl %0, %%esp"
+                : "=&r" (saved_esp) : "r" (CODE_START) : "memory");
+
+  vmstat (&after);
+  if (after.resident - before.resident != 1)
+    fail ("%u pages mapped for one stack page",
+          after.resident - before.resident);
+  msg ("one page mapped");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pt-grow-no-prefault) begin
+(pt-grow-no-prefault) one page mapped
+(pt-grow-no-prefault) end
+EOF
+pass;
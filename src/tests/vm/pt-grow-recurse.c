@@ -0,0 +1,29 @@
+/* Recurses deep enough to grow the stack by hundreds of
+   kilobytes, a page or so per call, and checks that every frame
+   kept its contents.
+   This must succeed. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH 256
+
+static int
+recurse (int depth)
+{
+  volatile char frame[1000];
+  int sum;
+
+  memset ((char *) frame, depth, sizeof frame);
+  sum = depth == 0 ? 0 : recurse (depth - 1);
+  if (frame[0] != (char) depth || frame[sizeof frame - 1] != (char) depth)
+    fail ("frame at depth %d corrupted", depth);
+  return sum + depth;
+}
+
+void
+test_main (void)
+{
+  msg ("sum: %d", recurse (DEPTH));
+}
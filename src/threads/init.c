@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <random.h>
+#include <round.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,6 +23,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -43,22 +45,51 @@
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* -vmstat: Print paging statistics when a process exits. */
+bool print_vm_stats;
+
+/* -stack: Largest size a user stack may grow to, in bytes. */
+size_t user_stack_limit = STACK_SIZE;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
 
-/* -filesys, -scratch, -swap: Names of block devices to use,
-   overriding the defaults. */
+/* -fscache: Sectors in the file system buffer cache, 0 for the
+   default. */
+static size_t fscache_sectors;
+
+/* -fscrash: Power off as if power failed right after the file
+   system's last journal commit. */
+bool fs_crash;
+
+/* -filesys, -scratch: Names of block devices to use, overriding
+   the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
-static const char *swap_bdev_name;
+/* -swap: Comma-separated list of block devices to swap to, each
+   optionally followed by ":PRIORITY", overriding the default of
+   every swap partition. */
+static char *swap_bdev_names;
+
+/* -zswap: Kilobytes of compressed swap cache, 0 to disable. */
+static size_t zswap_kb;
 #endif
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef USERPROG
+/* -rss: Resident set limit of processes, in pages, 0 for none. */
+static size_t rss_limit;
+
+/* -ksm: Frames scanned for identical pages per round, 0 for
+   none. */
+static size_t ksm_pages;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -90,7 +121,11 @@ main (void)
   /* Initialize ourselves as a thread so we can use locks,
      then enable console locking. */
   thread_init ();
-  console_init ();  
+  console_init ();
+#ifdef USERPROG
+  /* Inherited by every process started from here on. */
+  thread_current ()->rss_limit = rss_limit;
+#endif  
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
@@ -121,14 +156,22 @@ main (void)
   serial_init_queue ();
   timer_calibrate ();
 
+  /* The file system's page cache lives in the frame table. */
+  initialize_frame_table ();
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
   locate_block_devices ();
-  filesys_init (format_filesys);
+  filesys_init (format_filesys, fscache_sectors);
+#endif
+#ifdef USERPROG
+  start_ksm (ksm_pages);
+#endif
+#if defined (FILESYS) && defined (VM)
+  initialize_swap (swap_bdev_names, zswap_kb * 1024);
+#else
+  initialize_swap (NULL, 0);
 #endif
-  initialize_frame_table ();
-  initialize_swap();
 
   printf ("Boot complete.\n");
   
@@ -246,13 +289,19 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-fscache"))
+        fscache_sectors = atoi (value);
+      else if (!strcmp (name, "-fscrash"))
+        fs_crash = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
-        swap_bdev_name = value;
+        swap_bdev_names = value;
+      else if (!strcmp (name, "-zswap"))
+        zswap_kb = atoi (value);
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
@@ -260,6 +309,14 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-rss"))
+        rss_limit = atoi (value);
+      else if (!strcmp (name, "-stack"))
+        user_stack_limit = ROUND_UP ((size_t) atoi (value) * 1024, PGSIZE);
+      else if (!strcmp (name, "-ksm"))
+        ksm_pages = atoi (value);
+      else if (!strcmp (name, "-vmstat"))
+        print_vm_stats = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -372,15 +429,22 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -fscache=COUNT     Cache COUNT file system sectors (default 64).\n"
+          "  -fscrash           Power off as if power failed after a commit.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV:PRI,... Swap to each BDEV, higher PRI first.\n"
+          "  -zswap=KB          Keep up to KB of swap compressed in RAM.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -rss=COUNT         Limit each process to COUNT resident pages.\n"
+          "  -stack=KB          Let user stacks grow up to KB (default 8192).\n"
+          "  -ksm=COUNT         Merge identical pages, scanning COUNT per round.\n"
+          "  -vmstat            Print paging statistics on process exit.\n"
 #endif
           );
   shutdown_power_off ();
@@ -393,9 +457,6 @@ locate_block_devices (void)
 {
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
-#ifdef VM
-  locate_block_device (BLOCK_SWAP, swap_bdev_name);
-#endif
 }
 
 /* Figures out what block device to use for the given ROLE: the
@@ -9,4 +9,14 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* -vmstat: Print paging statistics when a process exits. */
+extern bool print_vm_stats;
+
+/* -stack: Largest size a user stack may grow to, in bytes. */
+extern size_t user_stack_limit;
+
+/* -fscrash: Power off as if power failed right after the file
+   system's last journal commit. */
+extern bool fs_crash;
+
 #endif /* threads/init.h */
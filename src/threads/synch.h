@@ -41,6 +41,25 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of readers may hold it at
+   once, or one writer alone.  Waiting writers keep new readers
+   out, so that writers do not starve. */
+struct rwlock
+  {
+    struct lock lock;           /* Guards the members below. */
+    struct condition readers_ok; /* Signaled when readers may enter. */
+    struct condition writer_ok; /* Signaled when a writer may enter. */
+    unsigned readers;           /* Readers holding the lock. */
+    unsigned waiting_writers;   /* Writers waiting for the lock. */
+    bool writer;                /* True if a writer holds the lock. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -12,6 +12,7 @@
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
+#include "filesys/directory.h"
 #include "userprog/process.h"
 #endif
 
@@ -182,6 +183,9 @@ thread_create (const char *name, int priority,
   if(t != initial_thread && t != idle_thread)
     {
       t->parent = thread_current();
+      t->rss_limit = thread_current()->rss_limit;
+      if (thread_current ()->cwd != NULL)
+        t->cwd = dir_reopen (thread_current ()->cwd);
       struct child_struct *child = malloc(sizeof(struct child_struct));
       child->tid = tid;
       child->exit_status = -1;
@@ -471,6 +475,8 @@ init_thread (struct thread *t, const char *name, int priority)
   t->priority = priority;
   t->magic = THREAD_MAGIC;
   list_init(&t->sup_page_table);
+  lock_init(&t->spt_lock);
+  list_init(&t->mappings);
   #ifdef USERPROG
   lock_init (&t->child_lock);
   cond_init (&t->child_condition);
@@ -479,6 +485,7 @@ init_thread (struct thread *t, const char *name, int priority)
   t->exited = false;
   t->exit_status = -1;
   t->exec = NULL;
+  t->cwd = NULL;
   #endif
 
   old_level = intr_disable ();
@@ -4,8 +4,11 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include <vmstat.h>
 #include "threads/synch.h"
 
+struct dir;
+
 /* States in a thread's life cycle. */
 enum thread_status
   {
@@ -115,7 +118,16 @@ struct thread
     struct list_elem child_elem;        /* List element for child list. */
     struct file *exec;
    struct list files;
+   struct dir *cwd;                    /* Working directory, or null for the root. */
    struct list sup_page_table;
+   struct lock spt_lock;               /* Guards sup_page_table and its frames. */
+   struct list mappings;               /* Files mapped by mmap. */
+   int next_mapid;                     /* Identifier of the next mapping. */
+   struct vmstat vm_stats;             /* Paging statistics, guarded by spt_lock. */
+   size_t rss_limit;                   /* Max resident pages, 0 for no limit. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
 
 
     /* Owned by thread.c. */
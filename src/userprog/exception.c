@@ -2,14 +2,19 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <madvise.h>
 #include "userprog/gdt.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/swap.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
+#include "userprog/uaccess.h"
 #include "devices/block.h"
 
 /* Number of page faults processed. */
@@ -115,6 +120,7 @@ kill (struct intr_frame *f)
     }
 }
 
+static void
 kill_thread_on_fault (struct intr_frame *f, void *fault_addr, bool not_present, bool write, bool user) {
    printf ("Page fault at %p: %s error %s page in %s context.\n",
          fault_addr,
@@ -124,13 +130,20 @@ kill_thread_on_fault (struct intr_frame *f, void *fault_addr, bool not_present,
    kill (f);
 }
 
+/* Loads SPTE's page from its file, or zero-fills it, into a new
+   frame and maps it.  File pages that line up with the page
+   cache map its frame instead.  Must hold the current thread's
+   spt_lock. */
 static bool link_on_fault(struct sup_page_table_entry *spte){
-   uint8_t *upage = spte->upage;
    struct file *file = spte->file;
    off_t offset = spte->offset;
    uint32_t read_bytes = spte->read_bytes;
    uint32_t zero_bytes = spte->zero_bytes;
-   bool writable = spte->writable;
+
+   struct vmstat *stats = &thread_current ()->vm_stats;
+
+   if (map_file_page(spte))
+      return true;
 
    uint8_t *kpage = allocate_frame();
    if (kpage == NULL){
@@ -140,43 +153,176 @@ static bool link_on_fault(struct sup_page_table_entry *spte){
    if (file == NULL){
       memset(kpage, 0, PGSIZE);
    } else {
-      file_seek(file, offset);
-      if (file_read(file, kpage, read_bytes) != (int) read_bytes){
+      if (file_read_at(file, kpage, read_bytes, offset) != (int) read_bytes){
          free_frame(kpage);
          return false;
       }
       memset(kpage + read_bytes, 0, zero_bytes);
    }
 
-   bool added = add_frame(upage, kpage, writable);
+   bool added = add_frame(spte, kpage);
    if (!added){
       free_frame(kpage);
       return false;
    }
 
-   /* Delete spte from the supplementary page table */
-   destroy_spte(spte);
-
+   if (file == NULL || read_bytes == 0)
+      stats->minor_faults++;
+   else
+      stats->major_faults++;
    return true;
 }
 
 
+/* Reads SPTE's page back from its swap slot into a new frame and
+   maps it.  Must hold the current thread's spt_lock. */
 static bool bring_from_swap(struct sup_page_table_entry *spte){
   struct thread *cur = thread_current();
-  void *upage = (void *) spte->upage;
-  bool writable = spte->writable;
-  block_sector_t swap_index = spte->swap_index;
 
-  // Lock this?
   void *kpage = allocate_frame();
+  if (kpage == NULL) {
+    return false;
+  }
+  swap_in(spte->swap_index, kpage);
+  spte->swapped = false;
+  spte->swap_index = -1;
+
+  bool success = add_frame(spte, kpage);
+  if (!success) {
+    free_frame(kpage);
+    return false;
+  }
 
-  bool success = add_frame(upage, kpage, writable);
-  swap_in(swap_index, kpage);
+  /* The slot was released by swap_in(), so the page must be
+     written out again if it is evicted, even if it stays clean. */
+  pagedir_set_dirty(cur->pagedir, spte->upage, true);
+  cur->vm_stats.major_faults++;
+  cur->vm_stats.swap_ins++;
+  return true;
+}
 
-  if (success) {
-    hash_delete(&cur->sup_page_table, &spte->elem);
-  }
-  return success;
+/* Pages read ahead of a fault on a page advised MADV_SEQUENTIAL,
+   and distance behind it at which pages are marked for early
+   eviction. */
+#define READ_AHEAD_PAGES 8
+#define EVICT_BEHIND_PAGES 8
+
+/* Called after SPTE's page, advised MADV_SEQUENTIAL, was brought
+   in.  Reads ahead the next pages with the same advice that are
+   backed by a file or swap, and clears the accessed bit of the
+   page well behind, so that the clock takes pages the scan has
+   passed before anything else.  Must hold the current thread's
+   spt_lock. */
+static void
+fault_around (struct sup_page_table_entry *spte)
+{
+  struct thread *t = thread_current ();
+  struct vmstat stats = t->vm_stats;
+  uint8_t *upage = spte->upage;
+  struct sup_page_table_entry *behind;
+  int i;
+
+  for (i = 1; i <= READ_AHEAD_PAGES; i++)
+    {
+      struct sup_page_table_entry *next = get_spte_by_vaddr (upage + i * PGSIZE);
+      if (next == NULL || next->advice != MADV_SEQUENTIAL)
+        break;
+      if (next->kpage != NULL)
+        continue;
+      if (next->swapped)
+        bring_from_swap (next);
+      else if (next->file != NULL && next->read_bytes > 0)
+        link_on_fault (next);
+    }
+
+  /* Read-ahead does not count as faulting. */
+  t->vm_stats.minor_faults = stats.minor_faults;
+  t->vm_stats.major_faults = stats.major_faults;
+
+  behind = get_spte_by_vaddr (upage - EVICT_BEHIND_PAGES * PGSIZE);
+  if (behind != NULL && behind->advice == MADV_SEQUENTIAL && behind->kpage != NULL)
+    pagedir_set_accessed (t->pagedir, behind->upage, false);
+}
+
+/* Stack pages mapped in advance below a new stack page once the
+   stack is seen growing into it from the page above. */
+#define STACK_PREFAULT_PAGES 4
+
+/* Returns true if UPAGE lies within user_stack_limit bytes of the
+   top of user memory. */
+static bool
+in_stack_region (void *upage)
+{
+  return is_user_vaddr (upage)
+         && (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) upage) <= user_stack_limit;
+}
+
+/* Returns true if a fault at FAULT_ADDR with the user stack
+   pointer at ESP looks like an access to the stack.  PUSHA
+   touches 32 bytes below ESP before moving it; anything further
+   below is a stray access, not growth. */
+static bool
+is_stack_access (void *fault_addr, void *esp)
+{
+  return (uint8_t *) fault_addr >= (uint8_t *) esp - 32
+         && in_stack_region (pg_round_down (fault_addr));
+}
+
+/* Returns true if UPAGE holds a stack page: an anonymous page in
+   the stack region, not part of the executable or a mapped
+   file.  Must hold the current thread's spt_lock. */
+static bool
+is_stack_page (void *upage)
+{
+  struct sup_page_table_entry *spte = get_spte_by_vaddr (upage);
+  return (spte != NULL && spte->file == NULL && !spte->mmaped
+          && in_stack_region (upage));
+}
+
+/* Maps a new zeroed stack page at UPAGE.  Must hold the current
+   thread's spt_lock. */
+static bool
+map_stack_page (void *upage)
+{
+  struct sup_page_table_entry *spte = add_spte (NULL, 0, 0, PGSIZE, upage, true);
+  if (spte == NULL)
+    return false;
+  if (!link_on_fault (spte))
+    {
+      destroy_spte (spte);
+      return false;
+    }
+  return true;
+}
+
+/* Grows the stack to cover UPAGE.  If the page above is already
+   stack, the stack is being pushed down a page at a time, as in
+   deep recursion, so up to STACK_PREFAULT_PAGES further pages
+   below are mapped too, without counting as faults.  Must hold
+   the current thread's spt_lock. */
+static bool
+grow_stack (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct vmstat stats;
+  uint8_t *page;
+  int i;
+
+  if (!map_stack_page (upage))
+    return false;
+  if (!is_stack_page ((uint8_t *) upage + PGSIZE))
+    return true;
+
+  stats = t->vm_stats;
+  for (i = 1; i <= STACK_PREFAULT_PAGES; i++)
+    {
+      page = (uint8_t *) upage - i * PGSIZE;
+      if (!in_stack_region (page) || get_spte_by_vaddr (page) != NULL
+          || !map_stack_page (page))
+        break;
+    }
+  t->vm_stats.minor_faults = stats.minor_faults;
+  return true;
 }
 
 /* Page fault handler.  This is a skeleton that must be filled in
@@ -223,51 +369,61 @@ page_fault (struct intr_frame *f)
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
 
-   struct sup_page_table_entry *spte = get_spte_by_vaddr((uint8_t *) pg_round_down(fault_addr));
-   if (spte == NULL){
-      struct thread *t = thread_current();
+  struct thread *t = thread_current ();
+  void *upage = pg_round_down (fault_addr);
+  bool success = false;
+
+  if (is_user_vaddr (fault_addr) && t->pagedir != NULL)
+    {
       void *esp = user ? f->esp : t->esp;
-      if (fault_addr >= (esp - 32) && fault_addr < PHYS_BASE) {
-        if (PHYS_BASE - pg_round_down(esp) >= STACK_SIZE) {
-          exit(-1);
-        }
 
-        uint8_t *kpage = allocate_frame();
-        if (kpage == NULL) {
-          exit(-1);
+      lock_acquire (&t->spt_lock);
+      struct sup_page_table_entry *spte = get_spte_by_vaddr (upage);
+      if (spte != NULL)
+        {
+          if (write && !spte->writable)
+            success = false;
+          else if (spte->kpage != NULL)
+            /* Resident, so this is a write to a page shared
+               copy-on-write since fork(), or a fault that raced
+               with the page being brought in again. */
+            {
+              success = !write || unshare_frame (spte);
+              if (success)
+                t->vm_stats.minor_faults++;
+            }
+          else if (spte->swapped)
+            success = bring_from_swap (spte);
+          else if (!write && spte->read_bytes == 0)
+            /* Untouched zero-fill page: share the zero page until
+               the first write copies it. */
+            {
+              success = map_zero_page (spte);
+              if (success)
+                t->vm_stats.minor_faults++;
+            }
+          else
+            success = link_on_fault (spte);
+
+          if (success && not_present && spte->advice == MADV_SEQUENTIAL)
+            fault_around (spte);
         }
-        memset (kpage, 0, PGSIZE);
-
-        bool install = pagedir_get_page (t->pagedir, pg_round_down(fault_addr)) == NULL
-            && pagedir_set_page (t->pagedir, pg_round_down(fault_addr), kpage, true);
+      else if (not_present && is_stack_access (fault_addr, esp))
+        success = grow_stack (upage);
+      lock_release (&t->spt_lock);
+    }
 
-        if (!install) {
-          free_frame(kpage);
-          exit(-1);
-        }
+  if (!success)
+    {
+      /* Kernel access through get_user() and friends: make the
+         access fail instead. */
+      if (!user && fixup_user_access (f))
         return;
-      }
-      kill_thread_on_fault(f, fault_addr, not_present, write, user);
-   }
 
-   if(write && !spte->writable){
-      #ifdef USERPROG
-      exit(-1);
-      #endif
-      kill_thread_on_fault(f, fault_addr, not_present, write, user);
-   }
-
-   if(!link_on_fault(spte)){
-      if(!bring_from_swap(spte)){
-         #ifdef USERPROG
-         printf("Failed to bring page from swap\n");
-         exit(-1);
-         #endif
-         printf("Failed to bring page from swap\n");
-         kill_thread_on_fault(f, fault_addr, not_present, write, user);
-      }
-   }
-   return;
-  
+      /* Bad user access, either directly or through a pointer
+         handed to a system call. */
+      if (user || (is_user_vaddr (fault_addr) && t->pagedir != NULL))
+        exit (-1);
+      kill_thread_on_fault (f, fault_addr, not_present, write, user);
+    }
 }
-
@@ -14,10 +14,12 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
+#include "vm/mmap.h"
 #include "vm/page.h"
 
 struct arguments {
@@ -29,10 +31,21 @@ struct file_descriptor
 {
   int fd;
   struct file *file;
+  struct dir *dir;                /* Open directory, if FILE is one. */
   struct list_elem elem;
   struct lock file_lock;
 };
+/* Hands the parent's state to a child created by fork(). */
+struct fork_info
+{
+  struct thread *parent;
+  struct intr_frame if_;          /* Parent's registers at the syscall. */
+  struct semaphore done;          /* Upped once the child is set up. */
+  bool success;
+};
+
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 bool load(struct arguments *arguments, void (**eip)(void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -49,7 +62,7 @@ process_execute (const char *file_name)
 
   tid_t tid;
 
-  fn_open_copy = allocate_frame();
+  fn_open_copy = palloc_get_page (0);
   if (fn_open_copy == NULL)
     return TID_ERROR;
 
@@ -57,14 +70,14 @@ process_execute (const char *file_name)
   tok = strtok_r (fn_open_copy, " ", &save);
   if (filesys_open(tok) == NULL || strlen(tok) > 14)
     {
-      free_frame(fn_open_copy);
+      palloc_free_page (fn_open_copy);
       return TID_ERROR;
     }
-  free_frame(fn_open_copy);
+  palloc_free_page (fn_open_copy);
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = allocate_frame();
+  fn_copy = palloc_get_page (0);
   if (fn_copy == NULL)
     return TID_ERROR;
   strlcpy (fn_copy, file_name, PGSIZE);
@@ -73,7 +86,7 @@ process_execute (const char *file_name)
   /* Create a new thread to execute FILE_NAME. */
   tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
   if (tid == TID_ERROR)
-    free_frame(fn_copy);
+    palloc_free_page (fn_copy);
 
   return tid;
 }
@@ -87,7 +100,7 @@ start_process (void *args)
   bool success;
   char *delimiter = " ";
   char *save_ptr;
-  struct arguments *arguments = (struct arguments *) allocate_frame();
+  struct arguments *arguments = palloc_get_page (0);
   char *file_name;
 
 
@@ -113,15 +126,10 @@ start_process (void *args)
   success = load (arguments, &if_.eip, &if_.esp);
 
   /* If load failed, quit. */
-  free_frame(args);
+  palloc_free_page (args);
+  palloc_free_page (arguments);
   if (!success) 
     thread_exit ();
-  else
-  {
-    filesys_create (file_name, 0);
-    thread_current ()->exec = filesys_open(file_name);
-    file_deny_write(thread_current ()->exec);
-  }
 
 
   /* Start the user process by simulating a return from an
@@ -134,6 +142,109 @@ start_process (void *args)
   NOT_REACHED ();
 }
 
+/* Creates a child process that is a copy of the current one,
+   resuming from the system call described by IF_.  Memory is
+   shared copy-on-write rather than copied.  Returns the child's
+   thread id in the parent, or TID_ERROR if the child cannot be
+   created; the child sees a return value of 0. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = cur;
+  info.if_ = *if_;
+  info.success = false;
+  sema_init (&info.done, 0);
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&info.done);
+  return info.success ? tid : TID_ERROR;
+}
+
+/* Duplicates the parent's open files into the current thread,
+   keeping descriptor numbers and file positions. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->files); e != list_end (&parent->files); e = list_next (e))
+    {
+      struct file_descriptor *pfd = list_entry (e, struct file_descriptor, elem);
+      struct file_descriptor *fd = malloc (sizeof *fd);
+      if (fd == NULL)
+        return false;
+      fd->file = file_reopen (pfd->file);
+      if (fd->file == NULL)
+        {
+          free (fd);
+          return false;
+        }
+      fd->dir = NULL;
+      if (pfd->dir != NULL)
+        {
+          fd->dir = dir_reopen (pfd->dir);
+          if (fd->dir == NULL)
+            {
+              file_close (fd->file);
+              free (fd);
+              return false;
+            }
+        }
+      file_seek (fd->file, file_tell (pfd->file));
+      fd->fd = pfd->fd;
+      lock_init (&fd->file_lock);
+      list_push_back (&cur->files, &fd->elem);
+    }
+  return true;
+}
+
+/* A thread function that turns a new thread into a copy of the
+   process that called fork(). */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *cur = thread_current ();
+  struct thread *parent = info->parent;
+  struct intr_frame if_ = info->if_;
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    goto done;
+  process_activate ();
+
+  if (parent->exec != NULL)
+    {
+      cur->exec = file_reopen (parent->exec);
+      if (cur->exec == NULL)
+        goto done;
+      file_deny_write (cur->exec);
+    }
+
+  info->success = fork_files (parent) && fork_sup_page_table (parent);
+
+ done:
+  /* INFO lives on the parent's stack, so it must not be touched
+     after the parent is woken. */
+  if (!info->success)
+    {
+      sema_up (&info->done);
+      thread_exit ();
+    }
+  sema_up (&info->done);
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -195,6 +306,12 @@ process_exit (void)
   }
   lock_release(&cur->child_lock);
 
+  /* Write back mapped files, then give back frames and swap
+     slots before the executable the pages are loaded from is
+     closed. */
+  remove_all_mappings ();
+  destroy_sup_page_table ();
+
   /* Close the executable file */
   if(cur->exec != NULL){
     file_allow_write(cur->exec);
@@ -213,10 +330,13 @@ process_exit (void)
     e = list_next(e);
     lock_acquire(&fdesc->file_lock);
     file_close(fdesc->file);
+    dir_close(fdesc->dir);
     lock_release(&fdesc->file_lock);
     list_remove(&fdesc->elem);
     free(fdesc);
   }
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -469,8 +589,11 @@ bool load(struct arguments *arguments, void (**eip)(void), void **esp)
   file_deny_write(file);
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  /* We arrive here whether the load is successful or not.  On
+     success the file stays open as T->exec, since pages are
+     loaded from it lazily. */
+  if (!success)
+    file_close (file);
   return success;
 }
 
@@ -554,7 +677,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-      add_spte(file, ofs, page_read_bytes, page_zero_bytes, upage, writable);
+      if (add_spte(file, ofs, page_read_bytes, page_zero_bytes, upage, writable) == NULL)
+        return false;
       ofs += page_read_bytes;
 
       /* Advance. */
@@ -570,18 +694,27 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp) 
 {
+  struct thread *t = thread_current ();
+  struct sup_page_table_entry *spte;
   uint8_t *kpage;
   bool success = false;
 
-  kpage = allocate_frame();
-  if (kpage != NULL) 
+  lock_acquire (&t->spt_lock);
+  spte = add_spte (NULL, 0, 0, PGSIZE, ((uint8_t *) PHYS_BASE) - PGSIZE, true);
+  if (spte != NULL)
     {
-      success = add_frame (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+      kpage = allocate_frame ();
+      memset (kpage, 0, PGSIZE);
+      success = add_frame (spte, kpage);
       if (success)
         *esp = PHYS_BASE;
       else
-        free_frame(kpage);
+        {
+          free_frame (kpage);
+          destroy_spte (spte);
+        }
     }
+  lock_release (&t->spt_lock);
   return success;
 }
 
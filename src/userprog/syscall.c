@@ -22,21 +22,30 @@
 #include "threads/pte.h"
 #include "threads/init.h"
 #include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
 
 
 typedef int pid_t;
+typedef int mapid_t;
 struct file_descriptor
 {
   int fd;
   struct file *file;
+  struct dir *dir;                /* Open directory, if FILE is one. */
   struct list_elem elem;
-  struct lock file_lock;
+  struct lock file_lock;          /* Guards the position in FILE. */
 };
 int get_new_fd (void);
 
-static struct lock file_lock;
+/* Most pages of a user buffer that read() and write() pin at
+   once, so that one large transfer cannot pin every frame and
+   leave eviction nothing to take. */
+#define PIN_PAGES 8
+
+static struct lock fd_lock;             /* Guards get_new_fd(). */
 static void syscall_handler (struct intr_frame *);
-static bool verify_user_pointer(const void *ptr);
 void exit(int status);
 static int write(int fd, const void *buffer, unsigned size);
 static void halt(void);
@@ -45,93 +54,187 @@ static pid_t exec (const char *cmd_line);
 static int wait (pid_t pid);
 static bool create (const char *file, unsigned initial_size);
 static bool remove (const char *file);
+static unsigned tell (int fd);
+static void close (int fd);
+static mapid_t mmap (int fd, void *addr);
+static void munmap (mapid_t mapping);
+static void vmstat (struct vmstat *stats);
+static int rsslimit (int pages);
+static int fsync (int fd);
+static bool chdir (const char *dir);
+static bool mkdir (const char *dir);
+static bool readdir (int fd, char *name);
+static bool isdir (int fd);
+static int inumber (int fd);
+static struct file_descriptor *find_fd (int fd);
 
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init(&file_lock);
+  lock_init (&fd_lock);
 }
 
 int 
 get_new_fd (void)
 {
   static int next_fd = 2;
-  return next_fd++;
+  int fd;
+
+  lock_acquire (&fd_lock);
+  fd = next_fd++;
+  lock_release (&fd_lock);
+  return fd;
 }
 
+/* Reads the CNT argument words above the system call number at
+   ESP into ARGS, terminating the process if they are not
+   readable user memory. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+get_args (const void *esp, uint32_t *args, size_t cnt)
 {
-  if(!verify_user_pointer(f->esp) || !verify_user_pointer(f->esp + 4) || !verify_user_pointer(f->esp + 8) || !verify_user_pointer(f->esp + 12) || pagedir_get_page(thread_current()->pagedir, f->esp) == NULL)
-    exit(-1);
-  int syscall_number = *(int *)f->esp;
+  if (!copy_from_user (args, (const uint32_t *) esp + 1, cnt * sizeof *args))
+    exit (-1);
+}
+
+/* Copies the null-terminated user string US into a new page,
+   truncating it to PGSIZE - 1 bytes, and returns the page, which
+   the caller must free with palloc_free_page().  Terminates the
+   process if US is not readable user memory. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks = palloc_get_page (0);
+  size_t length;
+
+  if (ks == NULL)
+    exit (-1);
+  for (length = 0; length < PGSIZE - 1; length++)
+    {
+      if (!get_user ((uint8_t *) ks + length, (const uint8_t *) us + length))
+        {
+          palloc_free_page (ks);
+          exit (-1);
+        }
+      if (ks[length] == '\0')
+        return ks;
+    }
+  ks[length] = '\0';
+  return ks;
+}
+
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  uint32_t args[3];
+  int syscall_number;
+
   thread_current()->esp = f->esp;
+  if (!copy_from_user (&syscall_number, f->esp, sizeof syscall_number))
+    exit(-1);
   switch(syscall_number)
   {
     case SYS_HALT:
       halt();
       break;
     case SYS_EXIT:
-      if(!verify_user_pointer(f->esp + 4))
-        exit(-1);
-      exit(*(int *)(f->esp + 4));
+      get_args(f->esp, args, 1);
+      exit((int) args[0]);
       break;
     case SYS_EXEC:
-      if(!verify_user_pointer(f->esp + 4))
-        exit(-1);
-      f->eax = exec((const char *)*(int *)(f->esp + 4));
+      get_args(f->esp, args, 1);
+      f->eax = exec((const char *) args[0]);
       break;
     case SYS_WAIT:
-      if(!verify_user_pointer(f->esp + 4))
-        exit(-1);
-      f->eax = wait(*(int *)(f->esp + 4));
+      get_args(f->esp, args, 1);
+      f->eax = wait((pid_t) args[0]);
       break;
     case SYS_CREATE:
-      if(!verify_user_pointer(f->esp + 4) || !verify_user_pointer(f->esp + 8))
-        exit(-1);
-      f->eax = create((const char *)*(int *)(f->esp + 4), *(unsigned *)(f->esp + 8));
+      get_args(f->esp, args, 2);
+      f->eax = create((const char *) args[0], args[1]);
       break;
     case SYS_REMOVE:
-      if(!verify_user_pointer(f->esp + 4))
-        exit(-1);
-      f->eax = remove((const char *)*(int *)(f->esp + 4));
+      get_args(f->esp, args, 1);
+      f->eax = remove((const char *) args[0]);
       break;
     case SYS_OPEN:
-      if(!verify_user_pointer(f->esp + 4))
-        exit(-1);
-      f->eax = open((const char *)*(int *)(f->esp + 4));
+      get_args(f->esp, args, 1);
+      f->eax = open((const char *) args[0]);
       break;
     case SYS_READ:
-      if(!verify_user_pointer(f->esp + 4) || !verify_user_pointer(f->esp + 8) || !verify_user_pointer(f->esp + 12))
-        exit(-1);
-      f->eax = read(*(int *)(f->esp + 4), (void *)*(int *)(f->esp + 8), *(unsigned *)(f->esp + 12));
+      get_args(f->esp, args, 3);
+      f->eax = read((int) args[0], (void *) args[1], args[2]);
       break;
     case SYS_WRITE:
-      if(!verify_user_pointer(f->esp + 4) || !verify_user_pointer(f->esp + 8) || !verify_user_pointer(f->esp + 12))
-        exit(-1);
-      f->eax = write(*(int *)(f->esp + 4), (const void *)*(int *)(f->esp + 8), *(unsigned *)(f->esp + 12));
+      get_args(f->esp, args, 3);
+      f->eax = write((int) args[0], (const void *) args[1], args[2]);
       break;
     case SYS_FILESIZE:
-      if(!verify_user_pointer(f->esp + 4))
-        exit(-1);
-      f->eax = filesize(*(int *)(f->esp + 4));
+      get_args(f->esp, args, 1);
+      f->eax = filesize((int) args[0]);
       break;
     case SYS_SEEK:
-      if(!verify_user_pointer(f->esp + 4) || !verify_user_pointer(f->esp + 8))
-        exit(-1);
-      f->eax = seek(*(int *)(f->esp + 4), *(unsigned *)(f->esp + 8));
+      get_args(f->esp, args, 2);
+      f->eax = seek((int) args[0], args[1]);
       break;
-
-}
-}
-
-static bool
-verify_user_pointer(const void *ptr)
-{
-  if (ptr == NULL || !is_user_vaddr(ptr) || pagedir_get_page(thread_current()->pagedir, ptr) == NULL)
-    return false;
-  return true;
+    case SYS_TELL:
+      get_args(f->esp, args, 1);
+      f->eax = tell((int) args[0]);
+      break;
+    case SYS_CLOSE:
+      get_args(f->esp, args, 1);
+      close((int) args[0]);
+      break;
+    case SYS_MMAP:
+      get_args(f->esp, args, 2);
+      f->eax = mmap((int) args[0], (void *) args[1]);
+      break;
+    case SYS_MUNMAP:
+      get_args(f->esp, args, 1);
+      munmap((mapid_t) args[0]);
+      break;
+    case SYS_CHDIR:
+      get_args(f->esp, args, 1);
+      f->eax = chdir((const char *) args[0]);
+      break;
+    case SYS_MKDIR:
+      get_args(f->esp, args, 1);
+      f->eax = mkdir((const char *) args[0]);
+      break;
+    case SYS_READDIR:
+      get_args(f->esp, args, 2);
+      f->eax = readdir((int) args[0], (char *) args[1]);
+      break;
+    case SYS_ISDIR:
+      get_args(f->esp, args, 1);
+      f->eax = isdir((int) args[0]);
+      break;
+    case SYS_INUMBER:
+      get_args(f->esp, args, 1);
+      f->eax = inumber((int) args[0]);
+      break;
+    case SYS_FORK:
+      f->eax = process_fork(f);
+      break;
+    case SYS_VMSTAT:
+      get_args(f->esp, args, 1);
+      vmstat((struct vmstat *) args[0]);
+      break;
+    case SYS_RSSLIMIT:
+      get_args(f->esp, args, 1);
+      f->eax = rsslimit((int) args[0]);
+      break;
+    case SYS_MADVISE:
+      get_args(f->esp, args, 3);
+      f->eax = advise_pages((void *) args[0], args[1], (int) args[2]) ? 0 : -1;
+      break;
+    case SYS_FSYNC:
+      get_args(f->esp, args, 1);
+      f->eax = fsync((int) args[0]);
+      break;
+    default:
+      exit(-1);
+  }
 }
 
 void
@@ -142,38 +245,67 @@ exit(int status)
   char *name = strtok_r(cur->name, " ", &save_ptr);
   thread_current()->exit_status = status;
   printf("%s: exit(%d)\n", name, status);
+  if (print_vm_stats)
+    {
+      struct vmstat *s = &cur->vm_stats;
+      printf("%s: vmstat: %u minor faults, %u major faults, %u swap-ins, "
+             "%u swap-outs, %u evictions, %u resident\n", name,
+             s->minor_faults, s->major_faults, s->swap_ins, s->swap_outs,
+             s->evictions, s->resident);
+    }
   thread_exit();
 }
 
-write(int fd, const void *buffer, unsigned size)
+/* Returns how many of the SIZE bytes at BUFFER lie within its
+   first PIN_PAGES pages. */
+static unsigned
+pin_chunk (const void *buffer, unsigned size)
 {
-  if(!verify_user_pointer(buffer) || !verify_user_pointer(buffer + size))
-    exit(-1);
-  if (fd == 1)
+  unsigned room = PIN_PAGES * PGSIZE - pg_ofs (buffer);
+  return size < room ? size : room;
+}
+
+write(int fd, const void *buffer_, unsigned size)
+{
+  const uint8_t *buffer = buffer_;
+  struct file_descriptor *fdesc = NULL;
+  int bytes_written = 0;
+
+  if (fd != 1)
     {
-      lock_acquire (&file_lock);
-      putbuf(buffer, size);
-      lock_release (&file_lock);
-      return size;
+      fdesc = find_fd (fd);
+      if (fdesc == NULL || fdesc->dir != NULL)
+        return -1;
     }
-  else
+
+  /* A few pages at a time, pinned, so that the copy out of BUFFER
+     never faults while a file lock is held. */
+  while (size > 0)
     {
-      struct file_descriptor *fdesc = NULL;
-      struct list_elem *e;
-      for (e = list_begin (&thread_current ()->files); e != list_end (&thread_current ()->files); e = list_next (e))
+      unsigned chunk = pin_chunk (buffer, size);
+      unsigned n;
+
+      pin_user_range (buffer, chunk, false);
+      if (fdesc == NULL)
         {
-          fdesc = list_entry (e, struct file_descriptor, elem);
-          if (fdesc->fd == fd)
-            break;
+          putbuf ((const char *) buffer, chunk);
+          n = chunk;
         }
-      if (fdesc == NULL)
-        return -1;
-      lock_acquire (&fdesc->file_lock);
-      int bytes_read = file_write (fdesc->file, buffer, size);
-      lock_release (&fdesc->file_lock);
-      return bytes_read;
-    }
+      else
+        {
+          lock_acquire (&fdesc->file_lock);
+          n = file_write (fdesc->file, buffer, chunk);
+          lock_release (&fdesc->file_lock);
+        }
+      unpin_user_range (buffer, chunk);
 
+      bytes_written += n;
+      buffer += n;
+      size -= n;
+      if (n < chunk)
+        break;
+    }
+  return bytes_written;
 }
 
 void
@@ -183,48 +315,42 @@ halt(void)
 }
 
 int
-open (const char *file)
+open (const char *ufile)
 {
   struct file *f = NULL;
   struct file_descriptor *fd = NULL;
   int f_d = -1;
-  if(!verify_user_pointer(file)){
-    exit(-1);
-  }
-  if (file != NULL)
+  char *file = copy_in_string (ufile);
+
+  f = filesys_open (file);
+  palloc_free_page (file);
+  if (f != NULL)
     {
-      lock_acquire(&file_lock);
-      f = filesys_open (file);
-      lock_release(&file_lock);
-      if (f != NULL)
+      fd = malloc (sizeof (struct file_descriptor));
+      if (fd == NULL)
         {
-          fd = malloc (sizeof (struct file_descriptor));
-          if (fd == NULL)
-            {
-              file_close (f);
-              return -1;
-            }
-          lock_acquire (&file_lock);
-          f_d = get_new_fd ();
-          fd->fd = f_d;
-          fd->file = f;
-          lock_init (&fd->file_lock);
-          list_push_back (&thread_current ()->files, &fd->elem);
-          lock_release (&file_lock);
+          file_close (f);
+          return -1;
         }
+      f_d = get_new_fd ();
+      fd->fd = f_d;
+      fd->file = f;
+      fd->dir = NULL;
+      if (inode_is_dir (file_get_inode (f)))
+        fd->dir = dir_open (inode_reopen (file_get_inode (f)));
+      lock_init (&fd->file_lock);
+      list_push_back (&thread_current ()->files, &fd->elem);
     }
 
   return f_d;
 }
 
 pid_t
-exec (const char *cmd_line)
+exec (const char *ucmd_line)
 {
-  if (cmd_line == NULL || verify_user_pointer(cmd_line) == false || verify_user_pointer(cmd_line + 4) == false)
-    exit(-1);
-  lock_acquire (&file_lock);
+  char *cmd_line = copy_in_string (ucmd_line);
   tid_t tid = process_execute (cmd_line);
-  lock_release (&file_lock);
+  palloc_free_page (cmd_line);
   if (tid == TID_ERROR)
     return -1;
   return tid;
@@ -238,93 +364,86 @@ wait (pid_t pid)
 }
 
 bool
-create (const char *file, unsigned initial_size)
+create (const char *ufile, unsigned initial_size)
 {
-  if (file == NULL || verify_user_pointer(file) == false)
-    exit(-1);
-  lock_acquire(&file_lock);
+  char *file = copy_in_string (ufile);
   bool result = filesys_create (file, initial_size);
-  lock_release(&file_lock);
-  
+  palloc_free_page (file);
+
   return result;
 }
 
 bool
-remove (const char *file)
+remove (const char *ufile)
 {
-  if (file == NULL)
+  if (ufile == NULL)
     return false;
 
-  lock_acquire(&file_lock);
+  char *file = copy_in_string (ufile);
   bool result = filesys_remove (file);
-  lock_release(&file_lock);
+  palloc_free_page (file);
   return result;
 }
 
 int
-read (int fd, void *buffer, unsigned size)
+read (int fd, void *buffer_, unsigned size)
 {
-  if(!verify_user_pointer(buffer) || !verify_user_pointer(buffer + size))
-    exit(-1);
-  if (fd == 0)
+  uint8_t *buffer = buffer_;
+  struct file_descriptor *fdesc = NULL;
+  int bytes_read = 0;
+
+  if (fd != 0)
     {
-      lock_acquire (&file_lock);
-      unsigned i;
-      for (i = 0; i < size; i++)
-        {
-          if (( (char *) buffer)[i] == '\0')
-            break;
-        }
-      lock_release (&file_lock);
-      return i;
+      fdesc = find_fd (fd);
+      if (fdesc == NULL || fdesc->dir != NULL)
+        return -1;
     }
-  else
+
+  /* A few pages at a time, pinned, so that file_read() can copy
+     straight into BUFFER while file locks are held. */
+  while (size > 0)
     {
-      struct file_descriptor *fdesc = NULL;
-      struct list_elem *e;
-      for (e = list_begin (&thread_current ()->files); e != list_end (&thread_current ()->files); e = list_next (e))
+      unsigned chunk = pin_chunk (buffer, size);
+      unsigned n;
+
+      pin_user_range (buffer, chunk, true);
+      if (fdesc == NULL)
         {
-          fdesc = list_entry (e, struct file_descriptor, elem);
-          if (fdesc->fd == fd)
-            break;
+          for (n = 0; n < chunk; n++)
+            if (buffer[n] == '\0')
+              break;
         }
-      if (fdesc == NULL)
-        return -1;
-      int bytes_read = file_read (fdesc->file, buffer, size);
-      return bytes_read;
+      else
+        {
+          lock_acquire (&fdesc->file_lock);
+          n = file_read (fdesc->file, buffer, chunk);
+          lock_release (&fdesc->file_lock);
+        }
+      unpin_user_range (buffer, chunk);
+
+      bytes_read += n;
+      buffer += n;
+      size -= n;
+      if (n < chunk)
+        break;
     }
+  return bytes_read;
 }
 
 int 
 filesize (int fd)
 {
-  struct file_descriptor *fdesc = NULL;
-  struct list_elem *e;
-  for (e = list_begin (&thread_current ()->files); e != list_end (&thread_current ()->files); e = list_next (e))
-    {
-      fdesc = list_entry (e, struct file_descriptor, elem);
-      if (fdesc->fd == fd)
-        break;
-    }
+  struct file_descriptor *fdesc = find_fd (fd);
   if (fdesc == NULL)
     return -1;
-  lock_acquire (&file_lock);
   int size = file_length (fdesc->file);
-  lock_release (&file_lock);
   return size;
 }
 
 int
 seek (int fd, unsigned position)
 {
-  struct file_descriptor *fdesc = NULL;
-  struct list_elem *e;
-  for (e = list_begin (&thread_current ()->files); e != list_end (&thread_current ()->files); e = list_next (e))
-    {
-      fdesc = list_entry (e, struct file_descriptor, elem);
-      if (fdesc->fd == fd)
-        break;
-    }
+  struct file_descriptor *fdesc = find_fd (fd);
   if (fdesc == NULL)
     return -1;
   lock_acquire (&fdesc->file_lock);
@@ -336,14 +455,7 @@ seek (int fd, unsigned position)
 unsigned
 tell (int fd)
 {
-  struct file_descriptor *fdesc = NULL;
-  struct list_elem *e;
-  for (e = list_begin (&thread_current ()->files); e != list_end (&thread_current ()->files); e = list_next (e))
-    {
-      fdesc = list_entry (e, struct file_descriptor, elem);
-      if (fdesc->fd == fd)
-        break;
-    }
+  struct file_descriptor *fdesc = find_fd (fd);
   if (fdesc == NULL)
     return -1;
   lock_acquire (&fdesc->file_lock);
@@ -355,19 +467,143 @@ tell (int fd)
 void
 close (int fd)
 {
-  struct file_descriptor *fdesc = NULL;
+  struct file_descriptor *fdesc = find_fd (fd);
+  if (fdesc == NULL)
+    return;
+  file_close (fdesc->file);
+  dir_close (fdesc->dir);
+  list_remove (&fdesc->elem);
+  free (fdesc);
+}
+
+mapid_t
+mmap (int fd, void *addr)
+{
+  struct file_descriptor *fdesc = find_fd (fd);
+  if (fdesc == NULL)
+    return -1;
+  return add_mapping (fdesc->file, addr);
+}
+
+void
+munmap (mapid_t mapping)
+{
+  remove_mapping (mapping);
+}
+
+void
+vmstat (struct vmstat *stats)
+{
+  struct thread *cur = thread_current ();
+  struct vmstat copy;
+
+  /* Copy out after releasing the lock, since writing to STATS may
+     fault. */
+  lock_acquire (&cur->spt_lock);
+  copy = cur->vm_stats;
+  lock_release (&cur->spt_lock);
+  pin_user_range (stats, sizeof *stats, true);
+  *stats = copy;
+  unpin_user_range (stats, sizeof *stats);
+}
+
+/* Sets the current process's resident set limit to PAGES, 0
+   meaning no limit, unless PAGES is negative, and returns the
+   previous limit.  A lower limit takes effect as the process
+   faults in more pages. */
+int
+rsslimit (int pages)
+{
+  struct thread *cur = thread_current ();
+  int old;
+
+  lock_acquire (&cur->spt_lock);
+  old = cur->rss_limit;
+  if (pages >= 0)
+    cur->rss_limit = pages;
+  lock_release (&cur->spt_lock);
+  return old;
+}
+
+/* Returns the current process's file descriptor FD, or a null
+   pointer if it has none by that number. */
+static struct file_descriptor *
+find_fd (int fd)
+{
   struct list_elem *e;
   for (e = list_begin (&thread_current ()->files); e != list_end (&thread_current ()->files); e = list_next (e))
     {
-      fdesc = list_entry (e, struct file_descriptor, elem);
+      struct file_descriptor *fdesc = list_entry (e, struct file_descriptor, elem);
       if (fdesc->fd == fd)
-        break;
+        return fdesc;
+    }
+  return NULL;
+}
+
+/* Returns once every change made to the file system so far,
+   including FD's data, is on disk.  Returns 0 if successful, -1
+   if FD is not an open file. */
+int
+fsync (int fd)
+{
+  if (find_fd (fd) == NULL)
+    return -1;
+  filesys_sync ();
+  return 0;
+}
+
+bool
+chdir (const char *udir)
+{
+  char *dir = copy_in_string (udir);
+  bool result = filesys_chdir (dir);
+  palloc_free_page (dir);
+  return result;
+}
+
+bool
+mkdir (const char *udir)
+{
+  char *dir = copy_in_string (udir);
+  bool result = filesys_mkdir (dir);
+  palloc_free_page (dir);
+  return result;
+}
+
+/* Reads the next entry of directory FD into NAME, which has room
+   for READDIR_MAX_LEN + 1 bytes.  Returns false if there are no
+   more entries or FD is not a directory. */
+bool
+readdir (int fd, char *uname)
+{
+  struct file_descriptor *fdesc = find_fd (fd);
+  char name[NAME_MAX + 1];
+  bool result;
+
+  if (fdesc == NULL || fdesc->dir == NULL)
+    return false;
+  result = dir_readdir (fdesc->dir, name);
+  if (result)
+    {
+      pin_user_range (uname, strlen (name) + 1, true);
+      strlcpy (uname, name, NAME_MAX + 1);
+      unpin_user_range (uname, strlen (name) + 1);
     }
+  return result;
+}
+
+bool
+isdir (int fd)
+{
+  struct file_descriptor *fdesc = find_fd (fd);
+  return fdesc != NULL && fdesc->dir != NULL;
+}
+
+int
+inumber (int fd)
+{
+  struct file_descriptor *fdesc = find_fd (fd);
   if (fdesc == NULL)
-    return;
-  lock_acquire (&file_lock);
-  file_close (fdesc->file);
-  lock_release (&file_lock);
-  list_remove (&fdesc->elem);
-  free (fdesc);
-}
\ No newline at end of file
+    return -1;
+  return inode_get_inumber (file_get_inode (fdesc->file));
+}
@@ -0,0 +1,142 @@
+#include "userprog/uaccess.h"
+#include "threads/vaddr.h"
+
+/* Kernel access to user memory.
+
+   The functions below simply perform the access.  Each
+   instruction that touches user memory gets an entry in the
+   __ex_table section pairing it with the address to resume at if
+   it faults.  When the page fault handler cannot bring in the
+   page, fixup_user_access() finds the entry and the function
+   returns failure instead of the process being killed, so
+   callers need not check pointers against the page table
+   beforehand.  Addresses must still be checked to lie below
+   PHYS_BASE, because kernel memory is mapped too. */
+
+/* An entry in the exception table. */
+struct exception_entry
+  {
+    uintptr_t insn;             /* Instruction that may fault. */
+    uintptr_t fixup;            /* Where to resume if it does. */
+  };
+
+/* Bounds of the exception table, from the linker script. */
+extern const struct exception_entry __start_ex_table[], __stop_ex_table[];
+
+/* Returns true if the SIZE bytes at UADDR lie in user space. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  const uint8_t *start = uaddr;
+  return start + size >= start && (size == 0 || is_user_vaddr (start + size - 1));
+}
+
+/* Reads a byte at user address USRC into *DST.  Returns false
+   if USRC is not readable user memory. */
+bool
+get_user (uint8_t *dst, const uint8_t *usrc)
+{
+  int error = 0;
+  uint8_t byte;
+
+  if (!is_user_vaddr (usrc))
+    return false;
+  asm volatile ("1: movb %2, %1\n"
+                "2:\n"
+                ".section .fixup, \"ax\"\n"
+                "3: movl $1, %0\n"
+                "   jmp 2b\n"
+                ".previous\n"
+                ".section __ex_table, \"a\"\n"
+                "   .long 1b, 3b\n"
+                ".previous"
+                : "+r" (error), "=q" (byte) : "m" (*usrc));
+  if (error)
+    return false;
+  *dst = byte;
+  return true;
+}
+
+/* Writes BYTE to user address UDST.  Returns false if UDST is
+   not writable user memory. */
+bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error = 0;
+
+  if (!is_user_vaddr (udst))
+    return false;
+  asm volatile ("1: movb %2, %1\n"
+                "2:\n"
+                ".section .fixup, \"ax\"\n"
+                "3: movl $1, %0\n"
+                "   jmp 2b\n"
+                ".previous\n"
+                ".section __ex_table, \"a\"\n"
+                "   .long 1b, 3b\n"
+                ".previous"
+                : "+r" (error), "=m" (*udst) : "q" (byte));
+  return !error;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  A fault in
+   the middle of the copy leaves ECX nonzero and resumes right
+   after it.  Returns false if any byte is not readable user
+   memory. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  size_t left;
+  int d0, d1;
+
+  if (!is_user_range (usrc, size))
+    return false;
+  asm volatile ("1: rep movsb\n"
+                "2:\n"
+                ".section __ex_table, \"a\"\n"
+                "   .long 1b, 2b\n"
+                ".previous"
+                : "=c" (left), "=D" (d0), "=S" (d1)
+                : "0" (size), "1" (dst), "2" (usrc)
+                : "memory");
+  return left == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns
+   false if any byte is not writable user memory. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  size_t left;
+  int d0, d1;
+
+  if (!is_user_range (udst, size))
+    return false;
+  asm volatile ("1: rep movsb\n"
+                "2:\n"
+                ".section __ex_table, \"a\"\n"
+                "   .long 1b, 2b\n"
+                ".previous"
+                : "=c" (left), "=D" (d0), "=S" (d1)
+                : "0" (size), "1" (udst), "2" (src)
+                : "memory");
+  return left == 0;
+}
+
+/* Called by the page fault handler for a kernel fault it could
+   not resolve.  If the faulting instruction is a user access in
+   the exception table, redirects F to its fixup and returns
+   true. */
+bool
+fixup_user_access (struct intr_frame *f)
+{
+  const struct exception_entry *e;
+
+  for (e = __start_ex_table; e < __stop_ex_table; e++)
+    if (e->insn == (uintptr_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        return true;
+      }
+  return false;
+}
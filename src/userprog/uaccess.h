@@ -0,0 +1,15 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+bool get_user (uint8_t *dst, const uint8_t *usrc);
+bool put_user (uint8_t *udst, uint8_t byte);
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+bool fixup_user_access (struct intr_frame *f);
+
+#endif /* userprog/uaccess.h */
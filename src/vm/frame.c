@@ -1,4 +1,6 @@
+#include <hash.h>
 #include <list.h>
+#include <radix.h>
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
@@ -6,119 +8,1090 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "userprog/pagedir.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
 #include <string.h>
 #include "vm/page.h"
+#include "vm/swap.h"
+#include "devices/timer.h"
+#include <stdio.h>
 
+/* Free-frame watermarks, as divisors of the user pool size.
+   Once fewer than frame_cnt / PAGEOUT_LOW_DIV frames are free,
+   allocate_frame() wakes the page-out daemon, which reclaims
+   until frame_cnt / PAGEOUT_HIGH_DIV frames are free again. */
+#define PAGEOUT_LOW_DIV 32
+#define PAGEOUT_HIGH_DIV 16
+
+/* Maximum number of frames the daemon unmaps and writes back
+   in one round. */
+#define PAGEOUT_BATCH 8
+
+/* Most pages pcache_read() copies under one hold of the inode's
+   lock. */
+#define PCACHE_READ_BATCH 8
+
+/* Milliseconds the same-page merging scanner sleeps between
+   rounds. */
+#define KSM_INTERVAL_MS 100
 
 struct frame {
     bool is_allocated;
     void *phys_base;
-    struct thread *thread;
-    struct list_elem elem; 
-    bool writable;
+    struct list sptes;                  /* Pages mapping the frame. */
+    unsigned refcnt;                    /* Number of pages in sptes. */
+    int pin_cnt;                        /* >0: never chosen for eviction. */
+    struct list_elem elem;              /* Element in frame_table. */
+    struct list_elem free_elem;         /* Element in free_frames. */
+
+    /* Page INDEX of INODE's data, if INODE is not NULL.  Such a
+       frame is listed in the inode's page cache and stays
+       allocated while no page maps it, until the clock takes it
+       or the inode is closed. */
+    struct inode *inode;
+    size_t index;
+    bool loading;                       /* Being read in from disk. */
+    bool accessed;                      /* Read through the cache lately. */
+
+    /* Anonymous frame write-protected by the same-page merging
+       scanner and listed in ksm_table, if in_ksm. */
+    bool in_ksm;
+    unsigned checksum;                  /* hash_bytes() of the page. */
+    struct hash_elem ksm_elem;          /* Element in ksm_table. */
+};
+
+/* A frame chosen for eviction by pick_victim(). */
+struct victim {
+    struct frame *frame;
+    bool dirty;                         /* Must be written back. */
+    struct sup_page_table_entry *mapped; /* Page of a mapped file, or NULL. */
 };
 
 void initialize_frame_table(void);
-void *allocate_frame();
+void *allocate_frame(void);
 void free_frame(void *phys_base);
 struct frame *evict_frame(void);
 
 static struct list frame_table;
+static struct list free_frames;         /* Frames not holding any page. */
 static struct lock frame_lock;
+static struct list_elem *clock_hand;    /* Next frame examined by the clock. */
+
+/* Signaled whenever a page cache frame finishes loading. */
+static struct condition pcache_loaded;
+
+/* Read-only page of zeros mapped by every zero-fill page until
+   it is first written.  Not part of the frame table. */
+static void *zero_page;
+
+/* Frames indexed by page number relative to frame_base. */
+static struct frame **frame_index;
+static uint8_t *frame_base;
+static size_t frame_index_cnt;
+static size_t frame_cnt;
+
+static size_t free_cnt;                 /* Length of free_frames. */
+static size_t low_watermark;
+static size_t high_watermark;
+static struct semaphore pageout_sema;   /* Upped to wake the daemon. */
+static bool pageout_running;            /* Daemon is awake. */
+
+/* Same-page merging.  Write-protected anonymous frames keyed by
+   the checksum of their contents, so that a frame found to hold
+   the same bytes as one of them can be merged into it. */
+static struct hash ksm_table;
+static size_t ksm_pages_per_round;      /* 0: scanner not running. */
+static struct list_elem *ksm_hand;      /* Next frame scanned. */
+static size_t ksm_scanned;              /* Frames scanned so far. */
+static size_t ksm_merged;               /* Frames freed by merging. */
+
+static void pageout_daemon(void *aux);
+static void ksm_daemon(void *aux);
+static hash_hash_func ksm_hash;
+static hash_less_func ksm_less;
 
 void initialize_frame_table(void) {
     list_init(&frame_table);
+    list_init(&free_frames);
     void *phys_base = palloc_get_page(PAL_USER);
+    uint8_t *last = phys_base;
     lock_init(&frame_lock);
+    frame_base = phys_base;
     while (phys_base != NULL) {
         struct frame *f = malloc(sizeof(struct frame));
         f->is_allocated = false;
         f->phys_base = phys_base;
-        f->thread = NULL;
+        list_init(&f->sptes);
+        f->refcnt = 0;
+        f->pin_cnt = 0;
+        f->inode = NULL;
+        f->index = 0;
+        f->loading = false;
+        f->accessed = false;
+        f->in_ksm = false;
         list_push_back(&frame_table, &f->elem);
+        list_push_back(&free_frames, &f->free_elem);
+        frame_cnt++;
+        if ((uint8_t *) phys_base < frame_base)
+            frame_base = phys_base;
+        if ((uint8_t *) phys_base > last)
+            last = phys_base;
         phys_base = palloc_get_page(PAL_USER);
     }
+
+    if (frame_cnt > 0) {
+        struct list_elem *e;
+        frame_index_cnt = (last - frame_base) / PGSIZE + 1;
+        frame_index = calloc(frame_index_cnt, sizeof *frame_index);
+        if (frame_index == NULL)
+            PANIC("Failed to allocate frame index");
+        for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
+            struct frame *f = list_entry(e, struct frame, elem);
+            frame_index[((uint8_t *) f->phys_base - frame_base) / PGSIZE] = f;
+        }
+    }
+    clock_hand = list_begin(&frame_table);
+    cond_init(&pcache_loaded);
+    hash_init(&ksm_table, ksm_hash, ksm_less, NULL);
+    zero_page = palloc_get_page(PAL_ZERO);
+    if (zero_page == NULL)
+        PANIC("Failed to allocate zero page");
+    free_cnt = frame_cnt;
+    low_watermark = frame_cnt / PAGEOUT_LOW_DIV;
+    high_watermark = frame_cnt / PAGEOUT_HIGH_DIV;
+
+    sema_init(&pageout_sema, 0);
+    thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
 }
 
-void *allocate_frame() {
-    lock_acquire(&frame_lock);
+/* Returns the frame whose page starts at PHYS_BASE, or NULL if
+   PHYS_BASE is not a user pool page. */
+static struct frame *get_frame(void *phys_base) {
+    uint8_t *kpage = phys_base;
+    if (kpage < frame_base || (size_t) (kpage - frame_base) / PGSIZE >= frame_index_cnt)
+        return NULL;
+    return frame_index[(kpage - frame_base) / PGSIZE];
+}
+
+static unsigned ksm_hash(const struct hash_elem *e, void *aux UNUSED) {
+    return hash_entry(e, struct frame, ksm_elem)->checksum;
+}
+
+static bool ksm_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED) {
+    const struct frame *a = hash_entry(a_, struct frame, ksm_elem);
+    const struct frame *b = hash_entry(b_, struct frame, ksm_elem);
+    return a->checksum < b->checksum;
+}
+
+/* Drops F from its inode's page cache, so that no new page maps
+   it, and from ksm_table, so that no page is merged into it.
+   Must hold frame_lock. */
+static void uncache_frame(struct frame *f) {
+    if (f->inode != NULL) {
+        radix_delete(inode_pages(f->inode), f->index);
+        f->inode = NULL;
+    }
+    if (f->in_ksm) {
+        hash_delete(&ksm_table, &f->ksm_elem);
+        f->in_ksm = false;
+    }
+}
+
+/* Hands F to the current thread.  The frame stays pinned until
+   add_frame() maps it.  Must hold frame_lock. */
+static void claim_frame(struct frame *f) {
+    f->is_allocated = true;
+    f->pin_cnt = 1;
+}
+
+/* Puts F back on the free list.  Must hold frame_lock. */
+static void release_frame(struct frame *f) {
+    ASSERT(list_empty(&f->sptes));
+    uncache_frame(f);
+    f->is_allocated = false;
+    f->refcnt = 0;
+    f->pin_cnt = 0;
+    f->accessed = false;
+    list_push_back(&free_frames, &f->free_elem);
+    free_cnt++;
+}
+
+/* Drops one page's reference to F, freeing F once no page maps
+   it, unless the page cache keeps it.  Must hold frame_lock. */
+static void put_frame(struct frame *f) {
+    if (--f->refcnt == 0 && f->inode == NULL && f->pin_cnt == 0)
+        release_frame(f);
+}
+
+/* Wakes the page-out daemon if free frames ran below the low
+   watermark.  Must hold frame_lock. */
+static void wake_pageout(void) {
+    if (free_cnt < low_watermark && !pageout_running) {
+        pageout_running = true;
+        sema_up(&pageout_sema);
+    }
+}
+
+/* Advances the clock hand, wrapping around the frame table. */
+static struct frame *clock_next(void) {
+    struct frame *f = list_entry(clock_hand, struct frame, elem);
+    clock_hand = list_next(clock_hand);
+    if (clock_hand == list_end(&frame_table))
+        clock_hand = list_begin(&frame_table);
+    return f;
+}
+
+/* Acquires the spt_lock of every process mapping F, so that
+   none of them can fault the page back in or tear it down while
+   it is being paged out.  The current thread must already hold
+   its own lock if it maps F.  Returns false, holding none of the
+   locks, if any of them is busy.  Must hold frame_lock. */
+static bool lock_mappers(struct frame *f) {
+    struct thread *cur = thread_current();
+    struct list_elem *e, *e2;
+
+    for (e = list_begin(&f->sptes); e != list_end(&f->sptes); e = list_next(e)) {
+        struct thread *t = list_entry(e, struct sup_page_table_entry, frame_elem)->owner;
+        if (lock_held_by_current_thread(&t->spt_lock))
+            continue;
+        if (t == cur || !lock_try_acquire(&t->spt_lock))
+            break;
+    }
+    if (e == list_end(&f->sptes))
+        return true;
+
+    /* Back out, releasing each lock taken above exactly once. */
+    for (e2 = list_begin(&f->sptes); e2 != e; e2 = list_next(e2)) {
+        struct thread *t = list_entry(e2, struct sup_page_table_entry, frame_elem)->owner;
+        if (t != cur && lock_held_by_current_thread(&t->spt_lock))
+            lock_release(&t->spt_lock);
+    }
+    return false;
+}
+
+/* Makes F, whose mappers are all locked, the victim described by
+   V: pins it, drops it from its inode's page cache and from
+   ksm_table, and unmaps it from every page table.  Must hold
+   frame_lock. */
+static void take_victim(struct frame *f, struct victim *v) {
     struct list_elem *e;
-    for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
-        struct frame *f = list_entry(e, struct frame, elem);
-        if (!f->is_allocated) {
-            f->is_allocated = true;
-            f->thread = thread_current();
-            lock_release(&frame_lock);
-            return f->phys_base;
+
+    f->pin_cnt++;
+    uncache_frame(f);
+    v->frame = f;
+    v->dirty = false;
+    v->mapped = NULL;
+    for (e = list_begin(&f->sptes); e != list_end(&f->sptes); e = list_next(e)) {
+        struct sup_page_table_entry *spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        uint32_t *pd = spte->owner->pagedir;
+        pagedir_clear_page(pd, spte->upage);
+        if (pagedir_is_dirty(pd, spte->upage))
+            v->dirty = true;
+        if (spte->mmaped)
+            v->mapped = spte;
+    }
+}
+
+/* Runs the clock algorithm to choose a frame to evict and stores
+   it into *V.  A frame counts as recently used if any of the
+   pages mapping it was accessed, or, for a page cache frame, if
+   it was read through the cache.  The chosen frame is pinned and
+   unmapped from every page table, and the spt_lock of each
+   mapper is held until page_out() is done with it.  Returns
+   false if no frame could be chosen in two sweeps.  Must hold
+   frame_lock. */
+static bool pick_victim(struct victim *v) {
+    size_t i;
+    for (i = 0; i < 2 * frame_cnt; i++) {
+        struct frame *f = clock_next();
+        struct list_elem *e;
+        bool accessed = f->accessed;
+
+        if (!f->is_allocated || f->pin_cnt > 0
+            || (list_empty(&f->sptes) && f->inode == NULL))
+            continue;
+
+        f->accessed = false;
+        for (e = list_begin(&f->sptes); e != list_end(&f->sptes); e = list_next(e)) {
+            struct sup_page_table_entry *spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+            uint32_t *pd = spte->owner->pagedir;
+            if (pagedir_is_accessed(pd, spte->upage)) {
+                pagedir_set_accessed(pd, spte->upage, false);
+                accessed = true;
+            }
         }
+        if (accessed || !lock_mappers(f))
+            continue;
+
+        take_victim(f, v);
+        return true;
     }
-    lock_release(&frame_lock);
-    return (evict_frame())->phys_base;
+    return false;
 }
 
-void free_frame(void *phys_base) {
-    lock_acquire(&frame_lock);
+/* Returns true if a page of T other than those already detached
+   still maps F. */
+static bool maps_frame(struct frame *f, struct thread *t) {
     struct list_elem *e;
-    for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
-        struct frame *f = list_entry(e, struct frame, elem);
-        if (f->phys_base == phys_base) {
-            f->is_allocated = false;
-            f->thread = NULL;
-            memset(phys_base, 0, PGSIZE);
-            lock_release(&frame_lock);
-            return;
+    for (e = list_begin(&f->sptes); e != list_end(&f->sptes); e = list_next(e))
+        if (list_entry(e, struct sup_page_table_entry, frame_elem)->owner == t)
+            return true;
+    return false;
+}
+
+/* Detaches every page from V's frame, recording SLOT as the swap
+   slot holding their contents if SLOT is not -1, and releases
+   the mappers' locks taken by pick_victim(). */
+static void detach_victim(struct victim *v, int slot) {
+    struct thread *cur = thread_current();
+    struct frame *f = v->frame;
+
+    while (!list_empty(&f->sptes)) {
+        struct sup_page_table_entry *spte = list_entry(list_pop_front(&f->sptes), struct sup_page_table_entry, frame_elem);
+        struct thread *t = spte->owner;
+
+        spte->kpage = NULL;
+        t->vm_stats.resident--;
+        t->vm_stats.evictions++;
+        if (slot != -1) {
+            spte->swapped = true;
+            spte->swap_index = slot;
+            t->vm_stats.swap_outs++;
+            if (!list_empty(&f->sptes))
+                swap_dup(slot);
+        }
+        if (t != cur && !maps_frame(f, t))
+            lock_release(&t->spt_lock);
+    }
+    f->refcnt = 0;
+}
+
+/* Writes back the CNT frames in VICTIMS and detaches them from
+   their pages.  Dirty pages of mapped files go back to the file;
+   other dirty frames go to swap in one batch, shared by all pages
+   that mapped them.  Clean frames are simply dropped, since they
+   can be read back from their file or zeroed again.  Must not
+   hold frame_lock. */
+static void page_out(struct victim *victims, size_t cnt) {
+    void *kpages[PAGEOUT_BATCH];
+    size_t slots[PAGEOUT_BATCH];
+    size_t dirty_cnt = 0;
+    size_t i;
+
+    ASSERT(cnt <= PAGEOUT_BATCH);
+    for (i = 0; i < cnt; i++) {
+        struct victim *v = &victims[i];
+        if (v->dirty && v->mapped != NULL) {
+            struct sup_page_table_entry *spte = v->mapped;
+            file_write_at(spte->file, v->frame->phys_base, spte->read_bytes, spte->offset);
+            v->dirty = false;
+        } else if (v->dirty)
+            kpages[dirty_cnt++] = v->frame->phys_base;
+    }
+    if (dirty_cnt > 0)
+        swap_out_batch(kpages, dirty_cnt, slots);
+
+    dirty_cnt = 0;
+    for (i = 0; i < cnt; i++)
+        detach_victim(&victims[i], victims[i].dirty ? (int) slots[dirty_cnt++] : -1);
+}
+
+/* Reclaims one of the current process's own frames once it has
+   reached its resident set limit, using the same second-chance
+   policy as the global clock over the process's pages, and
+   returns it claimed for the caller.  Pages that are pinned or
+   shared with other processes are passed over.  Returns NULL if
+   no page qualifies.  Must hold the current thread's
+   spt_lock. */
+static struct frame *reclaim_local(void) {
+    struct thread *t = thread_current();
+    struct list *spt = &t->sup_page_table;
+    size_t n = 2 * list_size(spt);
+    struct frame *f = NULL;
+    struct victim v;
+
+    lock_acquire(&frame_lock);
+    while (n-- > 0 && !list_empty(spt)) {
+        struct sup_page_table_entry *spte = list_entry(list_pop_front(spt), struct sup_page_table_entry, elem);
+        struct frame *candidate;
+
+        /* Rotate, so that the next search starts past SPTE. */
+        list_push_back(spt, &spte->elem);
+        candidate = spte->kpage != NULL ? get_frame(spte->kpage) : NULL;
+        if (candidate == NULL || candidate->pin_cnt > 0 || candidate->refcnt != 1)
+            continue;
+        if (pagedir_is_accessed(t->pagedir, spte->upage)) {
+            pagedir_set_accessed(t->pagedir, spte->upage, false);
+            continue;
         }
+        f = candidate;
+        break;
+    }
+    if (f == NULL) {
+        lock_release(&frame_lock);
+        return NULL;
     }
+    take_victim(f, &v);
+    lock_release(&frame_lock);
+
+    page_out(&v, 1);
+
+    lock_acquire(&frame_lock);
+    f->pin_cnt = 0;
+    claim_frame(f);
     lock_release(&frame_lock);
-    PANIC("No frame found to free");
+    return f;
 }
 
+/* Page-out daemon.  Sleeps until free frames drop below the low
+   watermark, then reclaims frames in batches until the high
+   watermark is reached again, so that faulting threads rarely
+   have to evict synchronously. */
+static void pageout_daemon(void *aux UNUSED) {
+    for (;;) {
+        sema_down(&pageout_sema);
 
-static struct frame *get_frame(void *phys_base) {
+        lock_acquire(&frame_lock);
+        while (free_cnt < high_watermark) {
+            struct victim victims[PAGEOUT_BATCH];
+            size_t cnt = 0;
+            size_t i;
+
+            while (cnt < PAGEOUT_BATCH && free_cnt + cnt < high_watermark
+                   && pick_victim(&victims[cnt]))
+                cnt++;
+            if (cnt == 0)
+                break;
+
+            lock_release(&frame_lock);
+            page_out(victims, cnt);
+            lock_acquire(&frame_lock);
+
+            for (i = 0; i < cnt; i++)
+                release_frame(victims[i].frame);
+        }
+        pageout_running = false;
+        lock_release(&frame_lock);
+    }
+}
+
+/* Returns true if every page mapping F is private, writable
+   memory that is not backed by a mapped file or the page cache,
+   so that its
+   contents may be shared copy-on-write with any other frame
+   holding the same bytes. */
+static bool is_anonymous(struct frame *f) {
+    struct list_elem *e;
+
+    if (list_empty(&f->sptes) || f->inode != NULL)
+        return false;
+    for (e = list_begin(&f->sptes); e != list_end(&f->sptes); e = list_next(e)) {
+        struct sup_page_table_entry *spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        if (!spte->writable || spte->mmaped)
+            return false;
+    }
+    return true;
+}
+
+/* Revokes write access from every page mapping F, so that its
+   contents stay put until one of them faults.  Must hold
+   frame_lock. */
+static void write_protect(struct frame *f) {
+    struct list_elem *e;
+    for (e = list_begin(&f->sptes); e != list_end(&f->sptes); e = list_next(e)) {
+        struct sup_page_table_entry *spte = list_entry(e, struct sup_page_table_entry, frame_elem);
+        pagedir_set_writable(spte->owner->pagedir, spte->upage, false);
+    }
+}
+
+/* Releases the spt_lock of the owner of each page in F's mapper
+   list from FIRST on, once per owner, after lock_mappers() took
+   them on behalf of another thread. */
+static void unlock_mappers(struct frame *f, struct list_elem *first) {
+    struct list_elem *e, *e2;
+
+    for (e = first; e != list_end(&f->sptes); e = list_next(e)) {
+        struct thread *t = list_entry(e, struct sup_page_table_entry, frame_elem)->owner;
+        for (e2 = list_next(e); e2 != list_end(&f->sptes); e2 = list_next(e2))
+            if (list_entry(e2, struct sup_page_table_entry, frame_elem)->owner == t)
+                break;
+        if (e2 == list_end(&f->sptes))
+            lock_release(&t->spt_lock);
+    }
+}
+
+/* Moves every page mapping F onto KEEP, which holds the same
+   bytes and is write-protected, and frees F.  Each page keeps its
+   dirty bit, since KEEP may not match what its file holds either.
+   The mappers' locks are released.  Must hold frame_lock. */
+static void merge_frame(struct frame *f, struct frame *keep) {
+    struct list_elem *first = NULL;
+
+    while (!list_empty(&f->sptes)) {
+        struct sup_page_table_entry *spte = list_entry(list_pop_front(&f->sptes), struct sup_page_table_entry, frame_elem);
+        uint32_t *pd = spte->owner->pagedir;
+        bool dirty = pagedir_is_dirty(pd, spte->upage);
+
+        pagedir_clear_page(pd, spte->upage);
+        if (!pagedir_set_page(pd, spte->upage, keep->phys_base, false))
+            PANIC("Failed to remap merged page");
+        pagedir_set_dirty(pd, spte->upage, dirty);
+        list_push_back(&keep->sptes, &spte->frame_elem);
+        if (first == NULL)
+            first = &spte->frame_elem;
+        spte->kpage = keep->phys_base;
+        keep->refcnt++;
+    }
+    f->refcnt = 0;
+    unlock_mappers(keep, first);
+    memset(f->phys_base, 0, PGSIZE);
+    release_frame(f);
+    ksm_merged++;
+}
+
+/* Examines F for same-page merging.  An unpinned anonymous frame
+   is write-protected and checksummed.  If a frame in ksm_table
+   has the same checksum and the same bytes, F's pages are merged
+   into it; otherwise F is entered into ksm_table in place of any
+   frame with that checksum.  Writes to either split them again
+   through unshare_frame().  Must hold frame_lock. */
+static void ksm_scan_frame(struct frame *f) {
+    struct hash_elem *e;
+    struct frame *other;
+
+    ksm_scanned++;
+    if (!f->is_allocated || f->pin_cnt > 0 || f->in_ksm
+        || !is_anonymous(f) || !lock_mappers(f))
+        return;
+
+    write_protect(f);
+    f->checksum = hash_bytes(f->phys_base, PGSIZE);
+    e = hash_find(&ksm_table, &f->ksm_elem);
+    other = e != NULL ? hash_entry(e, struct frame, ksm_elem) : NULL;
+    if (other != NULL && other->pin_cnt == 0
+        && !memcmp(other->phys_base, f->phys_base, PGSIZE)) {
+        merge_frame(f, other);
+        return;
+    }
+
+    if (other != NULL)
+        other->in_ksm = false;
+    hash_replace(&ksm_table, &f->ksm_elem);
+    f->in_ksm = true;
+    unlock_mappers(f, list_begin(&f->sptes));
+}
+
+/* Same-page merging scanner.  Every KSM_INTERVAL_MS, examines the
+   next ksm_pages_per_round frames of the frame table.  Runs at
+   the lowest priority, so it only uses otherwise idle time. */
+static void ksm_daemon(void *aux UNUSED) {
+    for (;;) {
+        size_t i;
+
+        timer_msleep(KSM_INTERVAL_MS);
+        lock_acquire(&frame_lock);
+        for (i = 0; i < ksm_pages_per_round && i < frame_cnt; i++) {
+            ksm_scan_frame(list_entry(ksm_hand, struct frame, elem));
+            ksm_hand = list_next(ksm_hand);
+            if (ksm_hand == list_end(&frame_table))
+                ksm_hand = list_begin(&frame_table);
+        }
+        lock_release(&frame_lock);
+    }
+}
+
+/* Starts merging identical anonymous pages, scanning PAGES frames
+   every KSM_INTERVAL_MS.  Does nothing if PAGES is 0. */
+void start_ksm(size_t pages) {
+    if (pages == 0 || frame_cnt == 0)
+        return;
+    ksm_pages_per_round = pages;
+    ksm_hand = list_begin(&frame_table);
+    thread_create("ksm", PRI_MIN, ksm_daemon, NULL);
+}
+
+/* Prints same-page merging statistics: frames scanned, frames
+   freed by merging, and the frames still shared among several
+   pages together with the frames that sharing saves. */
+void print_ksm_stats(void) {
     struct list_elem *e;
+    size_t shared = 0, saved = 0;
+
+    if (ksm_pages_per_round == 0)
+        return;
+    lock_acquire(&frame_lock);
     for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
         struct frame *f = list_entry(e, struct frame, elem);
-        if (f->phys_base == phys_base) {
-            return f;
+        if (f->in_ksm && f->refcnt > 1) {
+            shared++;
+            saved += f->refcnt - 1;
         }
     }
-    return NULL;
+    lock_release(&frame_lock);
+    printf("KSM: %zu frames scanned, %zu merged, %zu shared, %zu saved\n",
+           ksm_scanned, ksm_merged, shared, saved);
+}
+
+void *allocate_frame(void) {
+    struct thread *t = thread_current();
+
+    /* A process at its limit pages out one of its own frames
+       rather than taking one from everybody else. */
+    if (t->rss_limit != 0 && t->vm_stats.resident >= t->rss_limit
+        && lock_held_by_current_thread(&t->spt_lock)) {
+        struct frame *f = reclaim_local();
+        if (f != NULL)
+            return f->phys_base;
+    }
+
+    lock_acquire(&frame_lock);
+    if (!list_empty(&free_frames)) {
+        struct frame *f = list_entry(list_pop_front(&free_frames), struct frame, free_elem);
+        free_cnt--;
+        claim_frame(f);
+        wake_pageout();
+        lock_release(&frame_lock);
+        return f->phys_base;
+    }
+    lock_release(&frame_lock);
+    return (evict_frame())->phys_base;
 }
 
-bool add_frame(void *upage, void *kpage, bool writable) {
+void free_frame(void *phys_base) {
+    struct frame *f = get_frame(phys_base);
+    if (f == NULL || !f->is_allocated)
+        PANIC("No frame found to free");
+
     lock_acquire(&frame_lock);
-    struct thread *t = thread_current();    
+    memset(phys_base, 0, PGSIZE);
+    release_frame(f);
+    lock_release(&frame_lock);
+}
+
+bool add_frame(struct sup_page_table_entry *spte, void *kpage) {
+    struct thread *t = thread_current();
     struct frame *frame = get_frame(kpage);
 
-    bool result = (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+    bool result = (pagedir_get_page (t->pagedir, spte->upage) == NULL
+          && pagedir_set_page (t->pagedir, spte->upage, kpage, spte->writable));
 
     if (result) {
+        lock_acquire(&frame_lock);
         frame->is_allocated = true;
-        frame->thread = t;
-        frame->writable = writable;
+        list_push_back(&frame->sptes, &spte->frame_elem);
+        frame->refcnt++;
+        frame->pin_cnt--;
+        spte->kpage = kpage;
+        t->vm_stats.resident++;
+        lock_release(&frame_lock);
+    }
+
+    return result;
+}
+
+/* Returns the page cache frame holding page INDEX of INODE,
+   pinned, reading it in from disk if it is not cached yet.
+   Stores into *LOADED, if LOADED is not NULL, whether the page
+   had to be read.  Returns NULL if the page cannot be listed in
+   INODE's page cache because the radix tree is out of memory.
+   Release the frame with pcache_put(). */
+static struct frame *pcache_get(struct inode *inode, size_t index, bool *loaded) {
+    struct radix_tree *pages = inode_pages(inode);
+    struct frame *f, *cached;
+    off_t ofs = (off_t) index * PGSIZE;
+    off_t read;
+
+    if (loaded != NULL)
+        *loaded = false;
+    lock_acquire(&frame_lock);
+    while ((f = radix_lookup(pages, index)) != NULL && f->loading)
+        cond_wait(&pcache_loaded, &frame_lock);
+    if (f != NULL) {
+        f->pin_cnt++;
+        f->accessed = true;
+        lock_release(&frame_lock);
+        return f;
+    }
+    lock_release(&frame_lock);
+
+    f = get_frame(allocate_frame());
+
+    /* List the frame and read it in holding INODE's lock shared,
+       so that a racing load waits for this one and no write runs
+       until it is done.  A write thus always finds the page either
+       absent or loaded.  The frame comes first, since evicting a
+       page may write to INODE. */
+    inode_lock_shared(inode);
+    lock_acquire(&frame_lock);
+    while ((cached = radix_lookup(pages, index)) != NULL && cached->loading)
+        cond_wait(&pcache_loaded, &frame_lock);
+    if (cached != NULL || !radix_insert(pages, index, f)) {
+        release_frame(f);
+        if (cached != NULL) {
+            cached->pin_cnt++;
+            cached->accessed = true;
+        }
+        lock_release(&frame_lock);
+        inode_unlock_shared(inode);
+        return cached;
+    }
+    f->inode = inode;
+    f->index = index;
+    f->loading = true;
+    f->accessed = true;
+    lock_release(&frame_lock);
+
+    read = inode_read_at_locked(inode, f->phys_base, PGSIZE, ofs);
+    memset((uint8_t *) f->phys_base + read, 0, PGSIZE - read);
+
+    lock_acquire(&frame_lock);
+    f->loading = false;
+    cond_broadcast(&pcache_loaded, &frame_lock);
+    lock_release(&frame_lock);
+    inode_unlock_shared(inode);
+    if (loaded != NULL)
+        *loaded = true;
+    return f;
+}
+
+/* Undoes the pin of a pcache_get(), freeing F if its inode was
+   closed in the meantime and no page maps it. */
+static void pcache_put(struct frame *f) {
+    lock_acquire(&frame_lock);
+    ASSERT(f->pin_cnt > 0);
+    if (--f->pin_cnt == 0 && f->inode == NULL && f->refcnt == 0)
+        release_frame(f);
+    lock_release(&frame_lock);
+}
+
+/* Reads SIZE bytes of INODE's data starting at OFFSET into
+   BUFFER through the page cache.  Returns the number of bytes
+   read, which is less than SIZE if end of file is reached.
+
+   The pages are gathered up to PCACHE_READ_BATCH at a time and
+   copied with INODE's lock held shared, so that within a batch a
+   write is seen either entirely or not at all.  BUFFER must not
+   fault meanwhile, since a fault may have to write to INODE. */
+off_t pcache_read(struct inode *inode, void *buffer_, off_t size, off_t offset) {
+    uint8_t *buffer = buffer_;
+    off_t bytes_read = 0;
+
+    while (size > 0 && offset < inode_length(inode)) {
+        struct frame *frames[PCACHE_READ_BATCH];
+        size_t first = offset / PGSIZE;
+        size_t last = (offset + size - 1) / PGSIZE;
+        size_t cnt, i;
+        off_t chunk, copied;
+
+        for (cnt = 0; cnt < PCACHE_READ_BATCH && first + cnt <= last; cnt++) {
+            frames[cnt] = pcache_get(inode, first + cnt, NULL);
+            if (frames[cnt] == NULL)
+                break;
+        }
+        if (cnt == 0) {
+            /* No memory to cache the page: read around the cache. */
+            bytes_read += inode_read_at(inode, buffer + bytes_read, size, offset);
+            break;
+        }
+
+        inode_lock_shared(inode);
+        chunk = (off_t) (first + cnt) * PGSIZE - offset;
+        if (chunk > size)
+            chunk = size;
+        if (chunk > inode_length(inode) - offset)
+            chunk = inode_length(inode) - offset;
+        for (i = 0, copied = 0; copied < chunk; i++) {
+            size_t page_ofs = (offset + copied) % PGSIZE;
+            off_t n = PGSIZE - page_ofs;
+            if (n > chunk - copied)
+                n = chunk - copied;
+            memcpy(buffer + bytes_read + copied, (uint8_t *) frames[i]->phys_base + page_ofs, n);
+            copied += n;
+        }
+        inode_unlock_shared(inode);
+        for (i = 0; i < cnt; i++)
+            pcache_put(frames[i]);
+
+        size -= chunk;
+        offset += chunk;
+        bytes_read += chunk;
+    }
+    return bytes_read;
+}
+
+/* Copies the SIZE bytes at BUFFER, just written to INODE at
+   OFFSET, into the pages of INODE that are cached, so that they
+   stay in step with the disk.  Called by inode_write_at() with
+   INODE's lock held exclusive, so no page of INODE is loading. */
+void pcache_update(struct inode *inode, const void *buffer_, off_t size, off_t offset) {
+    const uint8_t *buffer = buffer_;
+    struct radix_tree *pages = inode_pages(inode);
+
+    while (size > 0) {
+        size_t page_ofs = offset % PGSIZE;
+        off_t chunk = PGSIZE - page_ofs;
+        struct frame *f;
+
+        if (chunk > size)
+            chunk = size;
+
+        lock_acquire(&frame_lock);
+        f = radix_lookup(pages, offset / PGSIZE);
+        if (f != NULL) {
+            ASSERT(!f->loading);
+            f->pin_cnt++;
+        }
+        lock_release(&frame_lock);
+
+        if (f != NULL) {
+            uint8_t *dst = (uint8_t *) f->phys_base + page_ofs;
+            /* A mapped file page written back from its own frame
+               is already up to date. */
+            if (dst != buffer)
+                memcpy(dst, buffer, chunk);
+            pcache_put(f);
+        }
+
+        size -= chunk;
+        offset += chunk;
+        buffer += chunk;
     }
+}
 
+/* Empties INODE's page cache once the last opener closes it.
+   Frames that a page still maps lose their identity and are
+   freed with their last mapper. */
+void pcache_drop_inode(struct inode *inode) {
+    struct radix_tree *pages = inode_pages(inode);
+    struct frame *f;
+    size_t index;
+
+    lock_acquire(&frame_lock);
+    while ((f = radix_first(pages, &index)) != NULL) {
+        ASSERT(!f->loading);
+        uncache_frame(f);
+        if (f->refcnt == 0 && f->pin_cnt == 0)
+            release_frame(f);
+    }
+    lock_release(&frame_lock);
+}
+
+/* Maps SPTE's page straight to the page cache frame holding its
+   file data, if the page covers a whole page of the file or the
+   last part of it, reading the data in first if it is not
+   cached.  Pages of mapped files share the frame writably, so
+   that every mapping and read() see the same bytes; other pages
+   map it read-only and take a private copy on their first
+   write.  Counts the fault.  Returns false if the page must be
+   read in the usual way.  Must hold the current thread's
+   spt_lock. */
+bool map_file_page(struct sup_page_table_entry *spte) {
+    struct thread *t = thread_current();
+    struct inode *inode;
+    struct frame *f;
+    bool loaded;
+    bool result = false;
+
+    if (spte->file == NULL || spte->read_bytes == 0 || spte->offset % PGSIZE != 0)
+        return false;
+    inode = file_get_inode(spte->file);
+    if (spte->read_bytes != PGSIZE
+        && spte->offset + (off_t) spte->read_bytes < inode_length(inode))
+        return false;
+
+    f = pcache_get(inode, spte->offset / PGSIZE, &loaded);
+    if (f == NULL)
+        return false;
+
+    lock_acquire(&frame_lock);
+    if (pagedir_get_page(t->pagedir, spte->upage) == NULL
+        && pagedir_set_page(t->pagedir, spte->upage, f->phys_base,
+                            spte->mmaped && spte->writable)) {
+        list_push_back(&f->sptes, &spte->frame_elem);
+        f->refcnt++;
+        spte->kpage = f->phys_base;
+        t->vm_stats.resident++;
+        result = true;
+    }
+    lock_release(&frame_lock);
+    pcache_put(f);
+
+    if (result && loaded)
+        t->vm_stats.major_faults++;
+    else if (result)
+        t->vm_stats.minor_faults++;
+    return result;
+}
+
+/* Maps the frame holding SRC read-only at DST's page in the
+   current thread as well, and write-protects SRC, so that the
+   first write through either page copies the frame.  DST's page
+   inherits SRC's dirty bit, because the contents are no longer
+   what DST's file holds.  Used by fork(). */
+bool share_frame(struct sup_page_table_entry *src, struct sup_page_table_entry *dst) {
+    struct frame *frame = get_frame(src->kpage);
+    uint32_t *src_pd = src->owner->pagedir;
+    uint32_t *dst_pd = dst->owner->pagedir;
+    bool result;
+
+    if (src->kpage == zero_page)
+        return map_zero_page(dst);
+
+    lock_acquire(&frame_lock);
+    result = pagedir_set_page(dst_pd, dst->upage, src->kpage, false);
+    if (result) {
+        pagedir_set_writable(src_pd, src->upage, false);
+        pagedir_set_dirty(dst_pd, dst->upage, pagedir_is_dirty(src_pd, src->upage));
+        list_push_back(&frame->sptes, &dst->frame_elem);
+        frame->refcnt++;
+        dst->kpage = src->kpage;
+        dst->owner->vm_stats.resident++;
+    }
     lock_release(&frame_lock);
     return result;
 }
 
+/* Maps the shared zero page read-only at SPTE's page, which
+   must be a zero-fill page, deferring the allocation of a frame
+   to the first write.  Must hold the current thread's
+   spt_lock. */
+bool map_zero_page(struct sup_page_table_entry *spte) {
+    uint32_t *pd = spte->owner->pagedir;
+
+    ASSERT(spte->read_bytes == 0);
+    if (pagedir_get_page(pd, spte->upage) != NULL
+        || !pagedir_set_page(pd, spte->upage, zero_page, false))
+        return false;
+    spte->kpage = zero_page;
+    return true;
+}
+
+/* Handles a write to SPTE's page while its frame is shared
+   copy-on-write.  The last page left on a frame just gets write
+   access back; otherwise, or if the frame belongs to the page
+   cache, the page moves to a private copy of the frame.  Must
+   hold the current thread's spt_lock. */
+bool unshare_frame(struct sup_page_table_entry *spte) {
+    struct thread *t = thread_current();
+    struct frame *frame = get_frame(spte->kpage);
+    void *kpage;
+
+    if (spte->kpage == zero_page) {
+        kpage = allocate_frame();
+        memset(kpage, 0, PGSIZE);
+        pagedir_clear_page(t->pagedir, spte->upage);
+        spte->kpage = NULL;
+        if (!add_frame(spte, kpage)) {
+            free_frame(kpage);
+            return false;
+        }
+        return true;
+    }
+
+    lock_acquire(&frame_lock);
+    if (frame->refcnt == 1 && frame->inode == NULL) {
+        uncache_frame(frame);
+        pagedir_set_writable(t->pagedir, spte->upage, true);
+        lock_release(&frame_lock);
+        return true;
+    }
+    frame->pin_cnt++;
+    lock_release(&frame_lock);
+
+    kpage = allocate_frame();
+    memcpy(kpage, frame->phys_base, PGSIZE);
+
+    lock_acquire(&frame_lock);
+    frame->pin_cnt--;
+    pagedir_clear_page(t->pagedir, spte->upage);
+    list_remove(&spte->frame_elem);
+    put_frame(frame);
+    spte->kpage = NULL;
+    t->vm_stats.resident--;
+    lock_release(&frame_lock);
+
+    if (!add_frame(spte, kpage)) {
+        free_frame(kpage);
+        return false;
+    }
+    pagedir_set_dirty(t->pagedir, spte->upage, true);
+    return true;
+}
+
+/* Keeps the frame holding SPTE's page, which must be resident,
+   from being evicted until unpin_frame().  Must hold the owner's
+   spt_lock. */
+void pin_frame(struct sup_page_table_entry *spte) {
+    struct frame *frame = get_frame(spte->kpage);
+
+    if (spte->kpage == zero_page)
+        return;
+    lock_acquire(&frame_lock);
+    frame->pin_cnt++;
+    lock_release(&frame_lock);
+}
+
+/* Undoes one pin_frame() on SPTE's page.  Must hold the owner's
+   spt_lock. */
+void unpin_frame(struct sup_page_table_entry *spte) {
+    struct frame *frame = get_frame(spte->kpage);
+
+    if (spte->kpage == zero_page)
+        return;
+    lock_acquire(&frame_lock);
+    ASSERT(frame->pin_cnt > 0);
+    frame->pin_cnt--;
+    lock_release(&frame_lock);
+}
+
+/* Removes SPTE's page from its frame, freeing the frame once no
+   page maps it anymore.  Must hold the owner's spt_lock. */
+void unmap_frame(struct sup_page_table_entry *spte) {
+    struct frame *frame = get_frame(spte->kpage);
+
+    if (spte->kpage == zero_page) {
+        pagedir_clear_page(spte->owner->pagedir, spte->upage);
+        spte->kpage = NULL;
+        return;
+    }
+
+    lock_acquire(&frame_lock);
+    pagedir_clear_page(spte->owner->pagedir, spte->upage);
+    list_remove(&spte->frame_elem);
+    spte->kpage = NULL;
+    spte->owner->vm_stats.resident--;
+    put_frame(frame);
+    lock_release(&frame_lock);
+}
+
+/* Evicts a page synchronously in the faulting thread.  Only
+   reached when the daemon has fallen behind and the free list
+   is empty.  Returns the freed frame, already claimed by the
+   current thread. */
 struct frame *evict_frame(void) {
-    struct list_elem *e;
-    for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
-        struct frame *f = list_entry(e, struct frame, elem);
-        if (f->thread == thread_current()) {
-            if (pagedir_is_dirty(f->thread->pagedir, f->phys_base)) {
-                struct sup_page_table_entry *p = get_spte_by_vaddr(f->phys_base);
-                    file_write_at(p->file, f->phys_base, PGSIZE, p->offset);
-                } else {
-                    swap_out(f->phys_base);
-                }
-            }
-            pagedir_clear_page(f->thread->pagedir, f->phys_base);
-            f->is_allocated = false;
-            f->thread = NULL;
-            return f;
+    struct frame *f = NULL;
+    struct victim v;
+
+    lock_acquire(&frame_lock);
+    wake_pageout();
+    while (f == NULL) {
+        if (!list_empty(&free_frames)) {
+            f = list_entry(list_pop_front(&free_frames), struct frame, free_elem);
+            free_cnt--;
+        } else if (pick_victim(&v)) {
+            lock_release(&frame_lock);
+            page_out(&v, 1);
+            lock_acquire(&frame_lock);
+            f = v.frame;
+            f->pin_cnt = 0;
+        } else {
+            /* Every frame is pinned or being paged out. */
+            lock_release(&frame_lock);
+            thread_yield();
+            lock_acquire(&frame_lock);
         }
-        PANIC("No frame found to evict");
-    }
\ No newline at end of file
+    }
+    claim_frame(f);
+    lock_release(&frame_lock);
+    return f;
+}
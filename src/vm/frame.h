@@ -1,8 +1,27 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct sup_page_table_entry;
+struct inode;
+
 void initialize_frame_table(void);
 void* allocate_frame(void);
 void free_frame(void* frame);
-bool add_frame(void *upage, void *kpage, bool writable);
+bool add_frame(struct sup_page_table_entry *spte, void *kpage);
+bool map_file_page(struct sup_page_table_entry *spte);
+bool map_zero_page(struct sup_page_table_entry *spte);
+bool share_frame(struct sup_page_table_entry *src, struct sup_page_table_entry *dst);
+bool unshare_frame(struct sup_page_table_entry *spte);
+void unmap_frame(struct sup_page_table_entry *spte);
+void pin_frame(struct sup_page_table_entry *spte);
+void unpin_frame(struct sup_page_table_entry *spte);
+void start_ksm(size_t pages);
+void print_ksm_stats(void);
+off_t pcache_read(struct inode *inode, void *buffer, off_t size, off_t offset);
+void pcache_update(struct inode *inode, const void *buffer, off_t size, off_t offset);
+void pcache_drop_inode(struct inode *inode);
 
 #endif
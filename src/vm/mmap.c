@@ -0,0 +1,141 @@
+#include "vm/mmap.h"
+#include <round.h>
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Returns true if the CNT pages starting at ADDR are all free
+   to be mapped: in user space, clear of the stack region and not
+   yet holding any page.  Must hold the current thread's
+   spt_lock. */
+static bool range_is_free(void *addr, size_t cnt){
+  size_t i;
+  for(i = 0; i < cnt; i++){
+    uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+    if(!is_user_vaddr(upage) || (size_t) ((uint8_t *) PHYS_BASE - upage) <= user_stack_limit
+       || get_spte_by_vaddr(upage) != NULL){
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Writes back and drops the first CNT pages of MAPPING.  Only
+   pages that are resident and were written to through the
+   mapping go back to the file; the rest already match it.  Must
+   hold the current thread's spt_lock. */
+static void unmap_pages(struct mapping *mapping, size_t cnt){
+  struct thread *cur = thread_current();
+  size_t i;
+  for(i = 0; i < cnt; i++){
+    uint8_t *upage = (uint8_t *) mapping->addr + i * PGSIZE;
+    struct sup_page_table_entry *spte = get_spte_by_vaddr(upage);
+    if(spte == NULL){
+      continue;
+    }
+    if(spte->kpage != NULL){
+      if(pagedir_is_dirty(cur->pagedir, upage)){
+        file_write_at(spte->file, spte->kpage, spte->read_bytes, spte->offset);
+      }
+      unmap_frame(spte);
+    }
+    destroy_spte(spte);
+  }
+}
+
+/* Maps FILE at ADDR in the current process.  Pages are read in
+   lazily by the page fault handler.  The mapping keeps its own
+   handle on the file, so it stays valid after FILE is closed or
+   removed.  Returns the mapping's identifier, or -1 if ADDR is
+   not page-aligned, FILE is empty or the range overlaps pages
+   already in use. */
+int add_mapping(struct file *file, void *addr){
+  struct thread *cur = thread_current();
+  struct mapping *mapping;
+  off_t length;
+  size_t i;
+
+  if(addr == NULL || pg_ofs(addr) != 0 || file == NULL){
+    return -1;
+  }
+  length = file_length(file);
+  if(length == 0){
+    return -1;
+  }
+
+  mapping = malloc(sizeof *mapping);
+  if(mapping == NULL){
+    return -1;
+  }
+  mapping->file = file_reopen(file);
+  if(mapping->file == NULL){
+    free(mapping);
+    return -1;
+  }
+  mapping->addr = addr;
+  mapping->page_cnt = DIV_ROUND_UP(length, PGSIZE);
+
+  lock_acquire(&cur->spt_lock);
+  if(!range_is_free(addr, mapping->page_cnt)){
+    goto fail;
+  }
+  for(i = 0; i < mapping->page_cnt; i++){
+    off_t ofs = i * PGSIZE;
+    size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+    struct sup_page_table_entry *spte = add_spte(mapping->file, ofs, read_bytes, PGSIZE - read_bytes, (uint8_t *) addr + ofs, true);
+    if(spte == NULL){
+      unmap_pages(mapping, i);
+      goto fail;
+    }
+    spte->mmaped = true;
+  }
+  lock_release(&cur->spt_lock);
+
+  mapping->id = cur->next_mapid++;
+  list_push_back(&cur->mappings, &mapping->elem);
+  return mapping->id;
+
+ fail:
+  lock_release(&cur->spt_lock);
+  file_close(mapping->file);
+  free(mapping);
+  return -1;
+}
+
+/* Unmaps MAPPING and frees it. */
+static void destroy_mapping(struct mapping *mapping){
+  struct thread *cur = thread_current();
+
+  lock_acquire(&cur->spt_lock);
+  unmap_pages(mapping, mapping->page_cnt);
+  lock_release(&cur->spt_lock);
+  list_remove(&mapping->elem);
+  file_close(mapping->file);
+  free(mapping);
+}
+
+/* Unmaps the mapping with identifier ID, if the current process
+   has one. */
+void remove_mapping(int id){
+  struct thread *cur = thread_current();
+  struct list_elem *e;
+  for(e = list_begin(&cur->mappings); e != list_end(&cur->mappings); e = list_next(e)){
+    struct mapping *mapping = list_entry(e, struct mapping, elem);
+    if(mapping->id == id){
+      destroy_mapping(mapping);
+      return;
+    }
+  }
+}
+
+/* Unmaps every mapping of the current process, at exit. */
+void remove_all_mappings(void){
+  struct thread *cur = thread_current();
+  while(!list_empty(&cur->mappings)){
+    destroy_mapping(list_entry(list_front(&cur->mappings), struct mapping, elem));
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+#include <list.h>
+#include "filesys/file.h"
+
+/* A file mapped into the address space by the mmap system call. */
+struct mapping {
+    int id;                     /* Mapping identifier. */
+    struct file *file;          /* Private handle on the mapped file. */
+    void *addr;                 /* First mapped page. */
+    size_t page_cnt;            /* Number of mapped pages. */
+    struct list_elem elem;      /* Element in thread's mappings. */
+};
+
+int add_mapping(struct file *file, void *addr);
+void remove_mapping(int id);
+void remove_all_mappings(void);
+
+#endif
@@ -2,20 +2,38 @@
 #include "threads/malloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "userprog/syscall.h"
 #include <stdbool.h>
 #include <stdio.h>
+#include <madvise.h>
+#include "userprog/uaccess.h"
 
-void add_spte(struct file *file, off_t ofs, uint32_t read_bytes, uint32_t zero_bytes, uint8_t *upage, bool writable){
+struct sup_page_table_entry *add_spte(struct file *file, off_t ofs, uint32_t read_bytes, uint32_t zero_bytes, uint8_t *upage, bool writable){
   struct sup_page_table_entry *spte = malloc(sizeof(struct sup_page_table_entry));
+  if(spte == NULL){
+    return NULL;
+  }
   spte->file = file;
   spte->offset = ofs;
   spte->read_bytes = read_bytes;
   spte->zero_bytes = zero_bytes;
   spte->upage = upage;
+  spte->kpage = NULL;
+  spte->owner = thread_current();
   spte->writable = writable;
+  spte->dirty = false;
+  spte->accessed = false;
+  spte->swapped = false;
+  spte->mmaped = false;
+  spte->advice = MADV_NORMAL;
+  spte->swap_index = -1;
 
   struct thread *cur = thread_current();
   list_push_back(&cur->sup_page_table, &spte->elem);
+  return spte;
 }
 
 struct sup_page_table_entry *get_spte_by_vaddr(uint8_t *vaddr){
@@ -33,4 +51,229 @@ struct sup_page_table_entry *get_spte_by_vaddr(uint8_t *vaddr){
 void destroy_spte(struct sup_page_table_entry *spte){
   list_remove(&spte->elem);
   free(spte);
-}
\ No newline at end of file
+}
+
+/* Releases every page of the current process: resident pages
+   give their frame back to the frame table and swapped pages
+   give back their slot.  Must run before the page directory is
+   destroyed, so that pagedir_destroy() never hands frame-table
+   pages back to palloc. */
+void destroy_sup_page_table(void){
+  struct thread *cur = thread_current();
+
+  lock_acquire(&cur->spt_lock);
+  while(!list_empty(&cur->sup_page_table)){
+    struct sup_page_table_entry *spte = list_entry(list_front(&cur->sup_page_table), struct sup_page_table_entry, elem);
+    if(spte->kpage != NULL){
+      unmap_frame(spte);
+    } else if(spte->swapped){
+      swap_free(spte->swap_index);
+    }
+    destroy_spte(spte);
+  }
+  lock_release(&cur->spt_lock);
+}
+
+/* Duplicates PARENT's supplemental page table into the current
+   thread for fork().  Resident pages are shared copy-on-write,
+   swapped pages share their slot, and pages that were never
+   loaded are read lazily through the child's own handle on the
+   executable.  Memory-mapped files are not inherited. */
+bool fork_sup_page_table(struct thread *parent){
+  struct thread *cur = thread_current();
+  struct list_elem *e;
+  bool success = true;
+
+  lock_acquire(&parent->spt_lock);
+  lock_acquire(&cur->spt_lock);
+  for(e = list_begin(&parent->sup_page_table); e != list_end(&parent->sup_page_table); e = list_next(e)){
+    struct sup_page_table_entry *pspte = list_entry(e, struct sup_page_table_entry, elem);
+    if(pspte->mmaped){
+      continue;
+    }
+    struct file *file = pspte->file == parent->exec ? cur->exec : pspte->file;
+    struct sup_page_table_entry *spte = add_spte(file, pspte->offset, pspte->read_bytes, pspte->zero_bytes, pspte->upage, pspte->writable);
+    if(spte == NULL){
+      success = false;
+      break;
+    }
+    spte->advice = pspte->advice;
+    if(pspte->kpage != NULL){
+      if(!share_frame(pspte, spte)){
+        success = false;
+        break;
+      }
+    } else if(pspte->swapped){
+      swap_dup(pspte->swap_index);
+      spte->swapped = true;
+      spte->swap_index = pspte->swap_index;
+    }
+  }
+  lock_release(&cur->spt_lock);
+  lock_release(&parent->spt_lock);
+  return success;
+}
+
+/* Reads the user byte at UADDR, so that the page fault handler
+   brings its page in or grows the stack, and if WRITE, gives the
+   page write access, making it private if it is shared
+   copy-on-write, as a write fault would.  Nothing is stored, so
+   the page stays clean unless the system call writes to it, and
+   a mapped file is written back only if it really changed.  An
+   invalid address terminates the process. */
+static void touch_user_byte(const void *uaddr, bool write){
+  struct thread *cur = thread_current();
+  void *upage = pg_round_down(uaddr);
+  struct sup_page_table_entry *spte;
+  uint8_t byte;
+  bool success;
+
+  if(!get_user(&byte, uaddr)){
+    exit(-1);
+  }
+  if(!write){
+    return;
+  }
+
+  lock_acquire(&cur->spt_lock);
+  spte = get_spte_by_vaddr(upage);
+  success = spte != NULL && spte->writable;
+  if(success && spte->kpage != NULL && !pagedir_is_writable(cur->pagedir, upage)){
+    success = unshare_frame(spte);
+  }
+  lock_release(&cur->spt_lock);
+  if(!success){
+    exit(-1);
+  }
+}
+
+/* Faults in every page of the LEN bytes at UADDR and pins their
+   frames, so that a system call can copy to or from them while
+   holding file system locks, without page faults or eviction
+   getting in the way.  WRITE requests pages the kernel may write
+   to.  Terminates the process if any byte of the range is not
+   valid user memory.  Undo with unpin_user_range().  Pinned
+   frames cannot be evicted, so LEN must span only a few pages. */
+void pin_user_range(const void *uaddr, size_t len, bool write){
+  struct thread *cur = thread_current();
+  uint8_t *start = pg_round_down(uaddr);
+  uint8_t *end = (uint8_t *) uaddr + len;
+  uint8_t *upage;
+
+  if(len == 0){
+    return;
+  }
+  if(end < (uint8_t *) uaddr || !is_user_vaddr(end - 1)){
+    exit(-1);
+  }
+
+  /* Validate the whole range first, so that the process never
+     dies with part of it pinned. */
+  for(upage = start; upage < end; upage += PGSIZE){
+    touch_user_byte(upage < (uint8_t *) uaddr ? uaddr : upage, write);
+  }
+
+  for(upage = start; upage < end; upage += PGSIZE){
+    for(;;){
+      struct sup_page_table_entry *spte;
+      lock_acquire(&cur->spt_lock);
+      spte = get_spte_by_vaddr(upage);
+      ASSERT(spte != NULL);
+      if(spte->kpage != NULL && (!write || pagedir_is_writable(cur->pagedir, upage))){
+        pin_frame(spte);
+        lock_release(&cur->spt_lock);
+        break;
+      }
+      lock_release(&cur->spt_lock);
+
+      /* Evicted since it was touched. */
+      touch_user_byte(upage < (uint8_t *) uaddr ? uaddr : upage, write);
+    }
+  }
+}
+
+/* Releases the pages pinned by pin_user_range() for the same
+   UADDR and LEN. */
+void unpin_user_range(const void *uaddr, size_t len){
+  struct thread *cur = thread_current();
+  uint8_t *end = (uint8_t *) uaddr + len;
+  uint8_t *upage;
+
+  if(len == 0){
+    return;
+  }
+  lock_acquire(&cur->spt_lock);
+  for(upage = pg_round_down(uaddr); upage < end; upage += PGSIZE){
+    unpin_frame(get_spte_by_vaddr(upage));
+  }
+  lock_release(&cur->spt_lock);
+}
+
+/* Drops SPTE's contents: resident pages give back their frame,
+   after writing it to the mapped file if dirty, and swapped pages
+   give back their slot.  The page is then read again from its
+   file, or zero-filled, on the next access.  Must hold the
+   current thread's spt_lock. */
+static void drop_page(struct sup_page_table_entry *spte){
+  if(spte->kpage != NULL){
+    if(spte->mmaped && pagedir_is_dirty(spte->owner->pagedir, spte->upage)){
+      file_write_at(spte->file, spte->kpage, spte->read_bytes, spte->offset);
+    }
+    unmap_frame(spte);
+  } else if(spte->swapped){
+    swap_free(spte->swap_index);
+    spte->swapped = false;
+    spte->swap_index = -1;
+  }
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the pages of the
+   LEN bytes starting at ADDR, which must be page-aligned.
+   MADV_WILLNEED faults the pages in now, MADV_DONTNEED drops
+   them, and the others set the access pattern that read-ahead in
+   the page fault handler goes by.  Pages in the range that are
+   not mapped are ignored.  Returns false if ADDR or ADVICE is
+   invalid. */
+bool advise_pages(void *addr, size_t len, int advice){
+  struct thread *cur = thread_current();
+  uint8_t *end = (uint8_t *) addr + len;
+  uint8_t *upage;
+
+  if(pg_ofs(addr) != 0 || end < (uint8_t *) addr || (len > 0 && !is_user_vaddr(end - 1))){
+    return false;
+  }
+
+  if(advice == MADV_WILLNEED){
+    /* Let the page fault handler bring each page in.  Reads of
+       pages that are not mapped just fail. */
+    for(upage = addr; upage < end; upage += PGSIZE){
+      uint8_t byte;
+      lock_acquire(&cur->spt_lock);
+      bool mapped = get_spte_by_vaddr(upage) != NULL;
+      lock_release(&cur->spt_lock);
+      if(mapped){
+        get_user(&byte, upage);
+      }
+    }
+    return true;
+  }
+
+  if(advice != MADV_NORMAL && advice != MADV_RANDOM
+     && advice != MADV_SEQUENTIAL && advice != MADV_DONTNEED){
+    return false;
+  }
+  lock_acquire(&cur->spt_lock);
+  for(upage = addr; upage < end; upage += PGSIZE){
+    struct sup_page_table_entry *spte = get_spte_by_vaddr(upage);
+    if(spte == NULL){
+      continue;
+    }
+    if(advice == MADV_DONTNEED){
+      drop_page(spte);
+    } else {
+      spte->advice = advice;
+    }
+  }
+  lock_release(&cur->spt_lock);
+  return true;
+}
@@ -4,14 +4,20 @@
 #include <list.h>
 #include "filesys/file.h"
 #include "filesys/off_t.h"
+struct thread;
+
 struct sup_page_table_entry {
     void *vaddr;
     void *upage;
+    void *kpage;                /* Frame holding the page, or NULL. */
+    struct thread *owner;       /* Process whose page this is. */
+    struct list_elem frame_elem; /* Element in the frame's mapper list. */
     bool writable;
     bool dirty;
     bool accessed;
     bool swapped;
     bool mmaped;
+    int advice;                 /* MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL. */
     int swap_index;
     struct file *file;
     off_t offset;
@@ -20,9 +26,14 @@ struct sup_page_table_entry {
     struct list_elem elem;
 };
 
-void add_spte(struct file *file, off_t ofs, uint32_t read_bytes, uint32_t zero_bytes, uint8_t *upage, bool writable);
+struct sup_page_table_entry *add_spte(struct file *file, off_t ofs, uint32_t read_bytes, uint32_t zero_bytes, uint8_t *upage, bool writable);
 struct sup_page_table_entry *get_spte_by_vaddr(uint8_t *vaddr);
 void destroy_spte(struct sup_page_table_entry *spte);
+void destroy_sup_page_table(void);
+bool fork_sup_page_table(struct thread *parent);
+void pin_user_range(const void *uaddr, size_t len, bool write);
+void unpin_user_range(const void *uaddr, size_t len);
+bool advise_pages(void *addr, size_t len, int advice);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -1,63 +1,294 @@
 #include "vm/swap.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "devices/block.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
 #include "lib/kernel/bitmap.h" 
+#include "vm/zswap.h"
 
 #define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 #define SWAP_FREE 0
 #define SWAP_IN_USE 1
 
-static struct block *swap_block;
+/* Most swap devices in use at once. */
+#define SWAP_MAX_DEVICES 4
+
+/* A block device that holds swap slots.  All devices share one
+   slot space, in which this one owns SLOT_CNT slots starting at
+   FIRST_SLOT. */
+struct swap_device {
+  struct block *block;
+  int priority;                 /* Higher fills first. */
+  size_t first_slot;
+  size_t slot_cnt;
+};
+
+/* Swap devices, in decreasing order of priority. */
+static struct swap_device swap_devices[SWAP_MAX_DEVICES];
+static size_t swap_device_cnt;
+static unsigned swap_stripe;    /* Rotates clusters among equals. */
+
 static struct bitmap *swap_map;
+static unsigned *swap_refs;     /* Pages sharing each slot after fork. */
 static struct lock swap_lock;
 
-void initialize_swap(void){
-  swap_block = block_get_role(3);
-  if(swap_block == NULL){
+/* Returns the device holding SWAP_INDEX. */
+static struct swap_device *slot_device(size_t swap_index){
+  for(size_t i = 0; i < swap_device_cnt; i++){
+    struct swap_device *d = &swap_devices[i];
+    if(swap_index - d->first_slot < d->slot_cnt){
+      return d;
+    }
+  }
+  PANIC("Swap slot %zu out of range", swap_index);
+}
+
+/* Writes PAGE to SWAP_INDEX on disk. */
+static void write_slot(size_t swap_index, const void *page){
+  struct swap_device *d = slot_device(swap_index);
+  block_sector_t sector = (swap_index - d->first_slot) * SECTORS_PER_PAGE;
+  for(size_t i = 0; i < SECTORS_PER_PAGE; i++){
+    block_write(d->block, sector + i, page + i * BLOCK_SECTOR_SIZE);
+  }
+}
+
+/* Reads SWAP_INDEX from disk into PAGE. */
+static void read_slot(size_t swap_index, void *page){
+  struct swap_device *d = slot_device(swap_index);
+  block_sector_t sector = (swap_index - d->first_slot) * SECTORS_PER_PAGE;
+  for(size_t i = 0; i < SECTORS_PER_PAGE; i++){
+    block_read(d->block, sector + i, page + i * BLOCK_SECTOR_SIZE);
+  }
+}
+
+/* Adds BLOCK as a swap device of the given PRIORITY, keeping
+   swap_devices sorted by priority.  Devices of equal priority
+   stay in the order they were added. */
+static void add_device(struct block *block, int priority){
+  size_t i;
+
+  if(swap_device_cnt >= SWAP_MAX_DEVICES){
+    PANIC("Too many swap devices");
+  }
+  for(i = swap_device_cnt; i > 0 && swap_devices[i - 1].priority < priority; i--){
+    swap_devices[i] = swap_devices[i - 1];
+  }
+  swap_devices[i].block = block;
+  swap_devices[i].priority = priority;
+  swap_devices[i].slot_cnt = block_size(block) / SECTORS_PER_PAGE;
+  swap_device_cnt++;
+  printf("swap: using %s, priority %d\n", block_name(block), priority);
+}
+
+/* Adds the devices listed in NAMES, a comma-separated list of
+   block device names each optionally followed by ":PRIORITY", or
+   every block device of swap type if NAMES is null. */
+static void add_devices(char *names){
+  if(names == NULL){
+    struct block *block;
+    for(block = block_first(); block != NULL; block = block_next(block)){
+      if(block_type(block) == BLOCK_SWAP){
+        add_device(block, 0);
+      }
+    }
+  } else {
+    char *name, *save_ptr;
+    for(name = strtok_r(names, ",", &save_ptr); name != NULL;
+        name = strtok_r(NULL, ",", &save_ptr)){
+      char *priority = strchr(name, ':');
+      struct block *block;
+      if(priority != NULL){
+        *priority++ = '\0';
+      }
+      block = block_get_by_name(name);
+      if(block == NULL){
+        PANIC("No such block device \"%s\"", name);
+      }
+      add_device(block, priority != NULL ? atoi(priority) : 0);
+    }
+  }
+}
+
+/* Sets up the swap devices named by DEVICES, as described for
+   add_devices().  Up to ZSWAP_BYTES of swapped pages are kept
+   compressed in memory in front of them; 0 sends every page
+   straight to disk. */
+void initialize_swap(char *devices, size_t zswap_bytes){
+  size_t slot_cnt = 0;
+
+  add_devices(devices);
+  if(swap_device_cnt == 0){
     PANIC("No swap block device found");
   }
-  swap_map = bitmap_create(block_size(swap_block) / SECTORS_PER_PAGE);
+  for(size_t i = 0; i < swap_device_cnt; i++){
+    swap_devices[i].first_slot = slot_cnt;
+    slot_cnt += swap_devices[i].slot_cnt;
+  }
+  block_set_role(BLOCK_SWAP, swap_devices[0].block);
+
+  swap_map = bitmap_create(slot_cnt);
   if(swap_map == NULL){
     PANIC("Failed to create swap bitmap");
   }
   bitmap_set_all(swap_map, SWAP_FREE);
+  swap_refs = calloc(bitmap_size(swap_map), sizeof *swap_refs);
+  if(swap_refs == NULL){
+    PANIC("Failed to create swap reference counts");
+  }
+  zswap_init(bitmap_size(swap_map), zswap_bytes, write_slot);
   lock_init(&swap_lock);
 }
 
-size_t swap_out(void *frame){
-  lock_acquire(&swap_lock);
-  size_t swap_index = bitmap_scan_and_flip(swap_map, 0, 1, SWAP_FREE);
+/* Claims CNT contiguous free slots on device D and returns the
+   first, or BITMAP_ERROR if D has no such run.  Must hold
+   swap_lock. */
+static size_t claim_on_device(struct swap_device *d, size_t cnt){
+  size_t first = bitmap_scan(swap_map, d->first_slot, cnt, SWAP_FREE);
+  if(first == BITMAP_ERROR || first + cnt > d->first_slot + d->slot_cnt){
+    return BITMAP_ERROR;
+  }
+  bitmap_set_multiple(swap_map, first, cnt, SWAP_IN_USE);
+  return first;
+}
 
-  if(swap_index == BITMAP_ERROR){
-    PANIC("Swap partition is full");
+/* Claims a cluster of CNT contiguous free slots and returns the
+   first, or BITMAP_ERROR if no device has room for all of them.
+   Devices are tried in decreasing order of priority.  Successive
+   clusters rotate among the devices of the highest priority that
+   has room, so that they are written and later read back from
+   several disks at once.  Must hold swap_lock. */
+static size_t claim_slots(size_t cnt){
+  size_t lo, hi;
+
+  for(lo = 0; lo < swap_device_cnt; lo = hi){
+    for(hi = lo + 1; hi < swap_device_cnt && swap_devices[hi].priority == swap_devices[lo].priority; hi++){
+      continue;
+    }
+    for(size_t i = 0; i < hi - lo; i++){
+      struct swap_device *d = &swap_devices[lo + (swap_stripe + i) % (hi - lo)];
+      size_t first = claim_on_device(d, cnt);
+      if(first != BITMAP_ERROR){
+        swap_stripe++;
+        return first;
+      }
+    }
   }
-  for(size_t i = 0; i < SECTORS_PER_PAGE; i++){
-    block_write(swap_block, swap_index * SECTORS_PER_PAGE + i, frame + i * BLOCK_SECTOR_SIZE);
+  return BITMAP_ERROR;
+}
+
+/* Drops one reference to SWAP_INDEX and frees the slot once
+   nobody refers to it anymore.  Must hold swap_lock. */
+static void release_slot(size_t swap_index){
+  if(bitmap_test(swap_map, swap_index) == SWAP_FREE){
+    PANIC("Trying to free a free swap slot");
+  }
+  if(--swap_refs[swap_index] == 0){
+    zswap_drop(swap_index);
+    bitmap_flip(swap_map, swap_index);
+  }
+}
+
+/* Writes the pages zswap evicted onto EVICTED to their slots, then
+   frees the cache entries and drops the references that kept the
+   slots reserved while they were written.  Must not hold
+   swap_lock. */
+static void write_evicted(struct list *evicted){
+  struct list_elem *e;
+  for(e = list_begin(evicted); e != list_end(evicted); e = list_next(e)){
+    zswap_write_back(e);
+  }
+  lock_acquire(&swap_lock);
+  while(!list_empty(evicted)){
+    release_slot(zswap_free(list_pop_front(evicted)));
   }
   lock_release(&swap_lock);
+}
+
+size_t swap_out(void *frame){
+  size_t swap_index;
+  swap_out_batch(&frame, 1, &swap_index);
   return swap_index;
 }
 
+/* Writes CNT frames to swap and stores the slot of FRAMES[i] into
+   INDEXES[i].  The batch goes to a single cluster of contiguous
+   slots when possible, so that it is one sequential sweep of one
+   disk.  Disk writes happen without swap_lock held, so that
+   batches bound for different devices proceed in parallel; no
+   one else can see the slots until they are returned.  Pages that
+   zswap evicts to make room are written the same way, their slots
+   reserved by an extra reference in the meantime. */
+void swap_out_batch(void **frames, size_t cnt, size_t *indexes){
+  bool stored[cnt];
+  struct list evicted;
+  struct list_elem *e;
+
+  list_init(&evicted);
+  lock_acquire(&swap_lock);
+  size_t first = claim_slots(cnt);
+  for(size_t i = 0; i < cnt; i++){
+    if(first != BITMAP_ERROR){
+      indexes[i] = first + i;
+    } else {
+      indexes[i] = claim_slots(1);
+      if(indexes[i] == BITMAP_ERROR){
+        PANIC("Swap partition is full");
+      }
+    }
+    swap_refs[indexes[i]] = 1;
+    stored[i] = zswap_store(indexes[i], frames[i], &evicted);
+  }
+  for(e = list_begin(&evicted); e != list_end(&evicted); e = list_next(e)){
+    swap_refs[zswap_slot(e)]++;
+  }
+  lock_release(&swap_lock);
+
+  for(size_t i = 0; i < cnt; i++){
+    if(!stored[i]){
+      write_slot(indexes[i], frames[i]);
+    }
+  }
+  write_evicted(&evicted);
+}
+
+/* Reads SWAP_INDEX into FRAME and drops the caller's reference
+   to it.  The caller's reference keeps the slot from being
+   reused while it is read from disk without swap_lock held. */
 void swap_in(size_t swap_index, void *frame){
+  bool loaded;
+
   lock_acquire(&swap_lock);
   if(bitmap_test(swap_map, swap_index) == SWAP_FREE){
     PANIC("Trying to swap in a free swap slot");
   }
-  for(size_t i = 0; i < SECTORS_PER_PAGE; i++){
-    block_read(swap_block, swap_index * SECTORS_PER_PAGE + i, frame + i * BLOCK_SECTOR_SIZE);
+  loaded = zswap_load(swap_index, frame);
+  lock_release(&swap_lock);
+
+  if(!loaded){
+    read_slot(swap_index, frame);
   }
-  bitmap_flip(swap_map, swap_index);
+
+  lock_acquire(&swap_lock);
+  release_slot(swap_index);
   lock_release(&swap_lock);
 }
 
 void swap_free(size_t swap_index){
   lock_acquire(&swap_lock);
-  if(bitmap_test(swap_map, swap_index) == SWAP_FREE){
-    PANIC("Trying to free a free swap slot");
-  }
-  bitmap_flip(swap_map, swap_index);
+  release_slot(swap_index);
+  lock_release(&swap_lock);
+}
+
+/* Adds a reference to SWAP_INDEX for a page that now shares the
+   slot, so that it survives until every sharer has read it back
+   or exited. */
+void swap_dup(size_t swap_index){
+  lock_acquire(&swap_lock);
+  ASSERT(bitmap_test(swap_map, swap_index) == SWAP_IN_USE);
+  swap_refs[swap_index]++;
   lock_release(&swap_lock);
-}
\ No newline at end of file
+}
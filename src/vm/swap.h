@@ -1,4 +1,7 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
 #include <list.h>
+#include <stddef.h>
 
 #include "devices/block.h"
 
@@ -7,7 +10,11 @@ struct swap_slot {
   block_sector_t sector;
 };
 
-void initialize_swap(void);
+void initialize_swap(char *devices, size_t zswap_bytes);
 void swap_in(size_t used_index, void *frame);
 size_t swap_out(void *frame);
-void swap_free(size_t used_index);
\ No newline at end of file
+void swap_out_batch(void **frames, size_t cnt, size_t *indexes);
+void swap_free(size_t used_index);
+void swap_dup(size_t used_index);
+
+#endif
@@ -0,0 +1,273 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed cache of swapped-out pages, kept in front of the
+   swap device.  A page that compresses well is held here under
+   its swap slot instead of being written to disk; once the pool
+   is full, the oldest entries are evicted to make room and later
+   written to their slots by the caller, outside swap_lock.
+   Everything else is serialized through swap_lock. */
+
+/* Largest entry kept, header included.  Entries must fit in one
+   malloc() block, so that the pool never spends a whole page on
+   a single entry. */
+#define ZSWAP_MAX_ENTRY 1024
+
+/* Codec parameters.  Offsets are 16 bits wide, which covers any
+   distance within a page. */
+#define MIN_MATCH 4
+#define HASH_BITS 12
+
+struct zswap_entry {
+    size_t slot;                /* Swap slot the page belongs to. */
+    size_t size;                /* Bytes of compressed data. */
+    struct list_elem elem;      /* In lru, oldest first, or evicted. */
+    uint8_t data[];             /* Compressed page. */
+};
+
+static struct zswap_entry **entries;    /* Entry of each slot, or NULL. */
+static struct list lru;
+static size_t pool_used;                /* Bytes allocated to entries. */
+static size_t pool_limit;               /* 0: cache disabled. */
+static zswap_writeback_func *writeback_page;
+
+/* Scratch space for the codec. */
+static uint16_t hash_table[1 << HASH_BITS];
+static uint8_t compress_buf[ZSWAP_MAX_ENTRY];
+static uint8_t *bounce_page;
+static struct lock bounce_lock;         /* Guards bounce_page. */
+
+/* Sets up the cache for SLOT_CNT swap slots, holding at most
+   POOL_BYTES of compressed data.  WRITEBACK is called to move
+   evicted entries to disk.  A POOL_BYTES of 0 leaves the cache
+   disabled. */
+void zswap_init(size_t slot_cnt, size_t pool_bytes, zswap_writeback_func *writeback) {
+    list_init(&lru);
+    lock_init(&bounce_lock);
+    writeback_page = writeback;
+    if (pool_bytes == 0)
+        return;
+
+    entries = calloc(slot_cnt, sizeof *entries);
+    bounce_page = palloc_get_page(0);
+    if (entries == NULL || bounce_page == NULL)
+        PANIC("Failed to set up compressed swap cache");
+    pool_limit = pool_bytes;
+}
+
+static unsigned lz_hash(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Appends a run length beyond the 4 bits held in the token as
+   a sequence of 255-valued bytes and a final remainder byte. */
+static uint8_t *put_length(uint8_t *op, size_t len) {
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+/* Appends a sequence of LIT_CNT literals from LIT followed by a
+   match of MATCH_LEN bytes at OFFSET, or no match if MATCH_LEN
+   is 0.  Returns the new end of output, or NULL if the sequence
+   does not fit before OP_END. */
+static uint8_t *emit(uint8_t *op, uint8_t *op_end, const uint8_t *lit, size_t lit_cnt,
+                     size_t offset, size_t match_len) {
+    size_t extra = match_len > 0 ? match_len - MIN_MATCH : 0;
+    size_t need = 1 + lit_cnt / 255 + 1 + lit_cnt + 2 + extra / 255 + 1;
+
+    if (need > (size_t) (op_end - op))
+        return NULL;
+    *op++ = (lit_cnt < 15 ? lit_cnt : 15) << 4 | (extra < 15 ? extra : 15);
+    if (lit_cnt >= 15)
+        op = put_length(op, lit_cnt - 15);
+    memcpy(op, lit, lit_cnt);
+    op += lit_cnt;
+    if (match_len > 0) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        if (extra >= 15)
+            op = put_length(op, extra - 15);
+    }
+    return op;
+}
+
+/* Compresses the page at SRC into DST with an LZ77 scheme in the
+   style of LZ4: each sequence is a token, literals, and a back
+   reference.  Returns the compressed size, or 0 if it would
+   exceed DST_MAX bytes. */
+static size_t lz_compress(const uint8_t *src, uint8_t *dst, size_t dst_max) {
+    const uint8_t *end = src + PGSIZE;
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + dst_max;
+
+    memset(hash_table, 0, sizeof hash_table);
+    while (ip + MIN_MATCH <= end) {
+        unsigned h = lz_hash(ip);
+        const uint8_t *ref = src + hash_table[h];
+        hash_table[h] = ip - src;
+        if (ref < ip && !memcmp(ref, ip, MIN_MATCH)) {
+            size_t len = MIN_MATCH;
+            while (ip + len < end && ref[len] == ip[len])
+                len++;
+            op = emit(op, op_end, anchor, ip - anchor, ip - ref, len);
+            if (op == NULL)
+                return 0;
+            ip += len;
+            anchor = ip;
+        } else
+            ip++;
+    }
+    op = emit(op, op_end, anchor, end - anchor, 0, 0);
+    return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads a length continued past the token's 4 bits. */
+static const uint8_t *get_length(const uint8_t *ip, size_t *len) {
+    uint8_t b;
+    do {
+        b = *ip++;
+        *len += b;
+    } while (b == 255);
+    return ip;
+}
+
+/* Expands SRC_LEN bytes produced by lz_compress() into the page
+   at DST. */
+static void lz_decompress(const uint8_t *src, size_t src_len, uint8_t *dst) {
+    const uint8_t *ip = src;
+    const uint8_t *ip_end = src + src_len;
+    uint8_t *op = dst;
+
+    while (ip < ip_end) {
+        unsigned token = *ip++;
+        size_t lit_cnt = token >> 4;
+        size_t len = token & 15;
+        const uint8_t *ref;
+
+        if (lit_cnt == 15)
+            ip = get_length(ip, &lit_cnt);
+        memcpy(op, ip, lit_cnt);
+        op += lit_cnt;
+        ip += lit_cnt;
+        if (ip >= ip_end)
+            break;
+
+        ref = op - (ip[0] | ip[1] << 8);
+        ip += 2;
+        if (len == 15)
+            ip = get_length(ip, &len);
+        len += MIN_MATCH;
+
+        /* Byte by byte, since the match may overlap its copy. */
+        while (len-- > 0)
+            *op++ = *ref++;
+    }
+    ASSERT(op == dst + PGSIZE);
+}
+
+/* Takes entry E out of the pool and appends it to EVICTED.  The
+   entry stays in entries[], so that its page can still be loaded
+   until zswap_free() once it is on disk. */
+static void evict_entry(struct zswap_entry *e, struct list *evicted) {
+    list_remove(&e->elem);
+    pool_used -= sizeof *e + e->size;
+    list_push_back(evicted, &e->elem);
+}
+
+/* Caches PAGE, which is going to swap slot SLOT, in compressed
+   form.  Older entries are evicted onto EVICTED as needed to stay
+   within the pool limit; the caller must keep their slots from
+   being freed, then pass each one to zswap_write_back() and
+   zswap_free().  Returns false, caching nothing, if the cache is
+   disabled or the page does not compress well enough; the caller
+   must then write the page to disk itself. */
+bool zswap_store(size_t slot, const void *page, struct list *evicted) {
+    struct zswap_entry *e;
+    size_t size;
+
+    if (pool_limit == 0)
+        return false;
+    ASSERT(entries[slot] == NULL);
+
+    size = lz_compress(page, compress_buf, ZSWAP_MAX_ENTRY - sizeof *e);
+    if (size == 0 || sizeof *e + size > pool_limit)
+        return false;
+    while (pool_used + sizeof *e + size > pool_limit)
+        evict_entry(list_entry(list_front(&lru), struct zswap_entry, elem), evicted);
+
+    e = malloc(sizeof *e + size);
+    if (e == NULL)
+        return false;
+    e->slot = slot;
+    e->size = size;
+    memcpy(e->data, compress_buf, size);
+    list_push_back(&lru, &e->elem);
+    entries[slot] = e;
+    pool_used += sizeof *e + size;
+    return true;
+}
+
+/* Decompresses the page cached for SLOT into PAGE.  Returns false
+   if the page is not cached and must be read from disk.  The
+   entry stays cached until zswap_drop(), since other processes
+   may still share the slot. */
+bool zswap_load(size_t slot, void *page) {
+    if (pool_limit == 0 || entries[slot] == NULL)
+        return false;
+    lz_decompress(entries[slot]->data, entries[slot]->size, page);
+    return true;
+}
+
+/* Forgets the page cached for SLOT, if any, once the slot is
+   freed. */
+void zswap_drop(size_t slot) {
+    struct zswap_entry *e;
+
+    if (pool_limit == 0 || entries[slot] == NULL)
+        return;
+    e = entries[slot];
+    list_remove(&e->elem);
+    entries[slot] = NULL;
+    pool_used -= sizeof *e + e->size;
+    free(e);
+}
+
+/* Returns the slot of the evicted entry at ELEM. */
+size_t zswap_slot(struct list_elem *elem) {
+    return list_entry(elem, struct zswap_entry, elem)->slot;
+}
+
+/* Writes the page of the evicted entry at ELEM to disk.  Does not
+   need swap_lock, as long as the entry's slot stays reserved. */
+void zswap_write_back(struct list_elem *elem) {
+    struct zswap_entry *e = list_entry(elem, struct zswap_entry, elem);
+
+    lock_acquire(&bounce_lock);
+    lz_decompress(e->data, e->size, bounce_page);
+    writeback_page(e->slot, bounce_page);
+    lock_release(&bounce_lock);
+}
+
+/* Frees the evicted entry at ELEM, which must already be removed
+   from its list, once its page is on disk.  Returns its slot. */
+size_t zswap_free(struct list_elem *elem) {
+    struct zswap_entry *e = list_entry(elem, struct zswap_entry, elem);
+    size_t slot = e->slot;
+
+    entries[slot] = NULL;
+    free(e);
+    return slot;
+}
@@ -0,0 +1,18 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Writes PAGE to swap slot SLOT on disk. */
+typedef void zswap_writeback_func(size_t slot, const void *page);
+
+void zswap_init(size_t slot_cnt, size_t pool_bytes, zswap_writeback_func *writeback);
+bool zswap_store(size_t slot, const void *page, struct list *evicted);
+bool zswap_load(size_t slot, void *page);
+void zswap_drop(size_t slot);
+size_t zswap_slot(struct list_elem *);
+void zswap_write_back(struct list_elem *);
+size_t zswap_free(struct list_elem *);
+
+#endif